@@ -1,10 +1,14 @@
+#define _GNU_SOURCE /* POSIX_SPAWN_SETSID */
 #include "atlas.h"
 #include "config.h"
 #include "util.h"
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 static void reload(const Arg *arg) { reload_config(); }
@@ -58,82 +62,35 @@ void free_command_args(char **argv) {
   free(argv);
 }
 
+/* kb->arg was compiled by parse_keybinding(), so nothing is parsed here */
 void executeKeybinding(Keybinding *kb) {
-  Arg arg = {0};
-  Arg direction = {0};
-
   switch (kb->action) {
   case ACTION_SPAWN:
-    if (kb->value[0]) {
-      char **argv = parse_command_string(kb->value);
-      if (argv) {
-        arg.v = argv;
-        spawn(&arg);
-        free_command_args(argv);
-      } else {
-        LOG_ERROR("Failed to parse command: %s", kb->value);
-      }
-    }
+    spawn(&kb->arg);
     break;
 
   case ACTION_KILLCLIENT:
-    killclient(&arg);
+    killclient(&kb->arg);
     break;
 
   case ACTION_RELOAD:
-    reload(&arg);
+    reload(&kb->arg);
     break;
 
   case ACTION_CYCLEFOCUS:
-    focusstack(&arg);
+    focusstack(&kb->arg);
     break;
 
   case ACTION_FOCUSMONITOR:
-    if (!kb->value[0]) {
-      LOG_ERROR("No direction specified for focusmonitor keybinding");
-      return;
-    }
-
-    if (strcasecmp(kb->value, "up") == 0) {
-      direction.i = DIR_UP;
-    } else if (strcasecmp(kb->value, "down") == 0) {
-      direction.i = DIR_DOWN;
-    } else if (strcasecmp(kb->value, "left") == 0) {
-      direction.i = DIR_LEFT;
-    } else if (strcasecmp(kb->value, "right") == 0) {
-      direction.i = DIR_RIGHT;
-    } else {
-      LOG_ERROR("Invalid direction specified for focusmonitor keybinding: %s",
-                kb->value);
-      return;
-    }
-    focusMonitor(&direction);
+    focusMonitor(&kb->arg);
     break;
 
   case ACTION_MOVETOMONITOR:
-    if (!kb->value[0]) {
-      LOG_ERROR("No direction specified for movetomonitor keybinding");
-      return;
-    }
-
-    if (strcasecmp(kb->value, "up") == 0) {
-      direction.i = DIR_UP;
-    } else if (strcasecmp(kb->value, "down") == 0) {
-      direction.i = DIR_DOWN;
-    } else if (strcasecmp(kb->value, "left") == 0) {
-      direction.i = DIR_LEFT;
-    } else if (strcasecmp(kb->value, "right") == 0) {
-      direction.i = DIR_RIGHT;
-    } else {
-      LOG_ERROR("Invalid direction specified for movetomonitor keybinding: %s",
-                kb->value);
-      return;
-    }
-    directWindowToMonitor(&direction);
+    directWindowToMonitor(&kb->arg);
     break;
 
   case ACTION_TOGGLEFLOATING:
-    toggleWindowFloating(&arg);
+    toggleWindowFloating(&kb->arg);
     break;
 
   case ACTION_TOGGLEFULLSCREEN:
@@ -145,51 +102,23 @@ void executeKeybinding(Keybinding *kb) {
     break;
 
   case ACTION_VIEWWORKSPACE:
-    // Convert workspace name to index
-    for (size_t i = 0; i < cfg.workspaceCount; i++) {
-      if (strcasecmp(kb->value, cfg.workspaces[i].name) == 0) {
-        arg.ui = 1 << i;
-        break;
-      }
-    }
-    viewWorkspace(&arg);
+    viewWorkspace(&kb->arg);
     break;
 
   case ACTION_MOVETOWORKSPACE:
-    // Convert workspace name to index
-    for (size_t i = 0; i < cfg.workspaceCount; i++) {
-      if (strcasecmp(kb->value, cfg.workspaces[i].name) == 0) {
-        arg.ui = 1 << i;
-        break;
-      }
-    }
-    moveToWorkspace(&arg);
+    moveToWorkspace(&kb->arg);
     break;
 
   case ACTION_DUPLICATETOWORKSPACE:
-    // Convert workspace name to index
-    for (size_t i = 0; i < cfg.workspaceCount; i++) {
-      if (strcasecmp(kb->value, cfg.workspaces[i].name) == 0) {
-        arg.ui = 1 << i;
-        break;
-      }
-    }
-    duplicateToWorkspace(&arg);
+    duplicateToWorkspace(&kb->arg);
     break;
 
   case ACTION_TOGGLEWORKSPACE:
-    // Convert workspace name to index
-    for (size_t i = 0; i < cfg.workspaceCount; i++) {
-      if (strcasecmp(kb->value, cfg.workspaces[i].name) == 0) {
-        arg.ui = 1 << i;
-        break;
-      }
-    }
-    toggleWorkspace(&arg);
+    toggleWorkspace(&kb->arg);
     break;
 
   case ACTION_QUIT:
-    quit(&arg);
+    quit(&kb->arg);
     break;
 
   default:
@@ -202,41 +131,63 @@ void killclient(const Arg *arg) {
   if (!selectedMonitor->active)
     return;
   if (!sendevent(selectedMonitor->active, wmAtoms[WM_DELETE])) {
+    unsigned long first = startIgnoringXErrors();
     XGrabServer(display);
-    XSetErrorHandler(handleXErrorDummy);
     XSetCloseDownMode(display, DestroyAll);
     XKillClient(display, selectedMonitor->active->win);
-    XSync(display, False);
-    XSetErrorHandler(handleXError);
     XUngrabServer(display);
+    stopIgnoringXErrors(first);
   }
 }
 
 void quit(const Arg *arg) { isWMRunning = 0; }
 
-void spawn(const Arg *arg) {
-  struct sigaction sa;
-
-  if (fork() == 0) {
-    if (display)
-      close(ConnectionNumber(display));
-    setsid();
-
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = 0;
-    sa.sa_handler = SIG_DFL;
-    sigaction(SIGCHLD, &sa, NULL);
-
-    execvp(((char **)arg->v)[0], (char **)arg->v);
-    LOG_ERROR("Failed to execute '%s'", ((char **)arg->v)[0]);
+/* Starts argv in its own session with default signal handling and an empty
+ * signal mask. posix_spawnp() does not copy our address space the way fork()
+ * does, so launch time does not grow with the WM's memory, and exec failures
+ * come back as its return value. The X connection and event loop fds are
+ * close-on-exec. Returns the child's pid, or -1 */
+pid_t launchProgram(char *const argv[]) {
+  posix_spawnattr_t attr;
+  sigset_t mask;
+  struct timespec start, end;
+  pid_t pid;
+  int err;
+
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGDEF |
+                                      POSIX_SPAWN_SETSIGMASK);
+  /* SIGCHLD is ignored here, and the event loop blocks the signals it reads */
+  sigfillset(&mask);
+  posix_spawnattr_setsigdefault(&attr, &mask);
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  err = posix_spawnp(&pid, argv[0], NULL, &attr, argv, environ);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  posix_spawnattr_destroy(&attr);
+
+  if (err) {
+    LOG_ERROR("Failed to execute '%s': %s", argv[0], strerror(err));
+    return -1;
   }
+  LOG_DEBUG("Launched '%s' (pid %d) in %.3f ms", argv[0], pid,
+            (end.tv_sec - start.tv_sec) * 1e3 +
+                (end.tv_nsec - start.tv_nsec) / 1e6);
+  return pid;
 }
 
+void spawn(const Arg *arg) { launchProgram((char *const *)arg->v); }
+
 void moveToWorkspace(const Arg *arg) {
   if (selectedMonitor->active && arg->ui & WORKSPACEMASK) {
+    invalidateLayout(selectedMonitor, selectedMonitor->active->workspaces |
+                                          (arg->ui & WORKSPACEMASK));
     selectedMonitor->active->workspaces = arg->ui & WORKSPACEMASK;
-    focus(NULL);
-    arrange(selectedMonitor);
+    relinkVisibleClient(selectedMonitor->active);
+    scheduleFocus(NULL, 0);
+    scheduleArrange(selectedMonitor);
   }
 }
 
@@ -247,9 +198,12 @@ void duplicateToWorkspace(const Arg *arg) {
     return;
   newtags = selectedMonitor->active->workspaces ^ (arg->ui & WORKSPACEMASK);
   if (newtags) {
+    invalidateLayout(selectedMonitor,
+                     selectedMonitor->active->workspaces | newtags);
     selectedMonitor->active->workspaces = newtags;
-    focus(NULL);
-    arrange(selectedMonitor);
+    relinkVisibleClient(selectedMonitor->active);
+    scheduleFocus(NULL, 0);
+    scheduleArrange(selectedMonitor);
   }
   updateCurrentDesktop();
 }
@@ -262,8 +216,10 @@ void toggleWorkspace(const Arg *arg) {
   if (newtagset) {
     selectedMonitor->workspaceset[selectedMonitor->selectedWorkspaces] =
         newtagset;
-    focus(NULL);
-    arrange(selectedMonitor);
+    invalidateVisibleClients(selectedMonitor);
+    noteWorkspaceSwitch();
+    scheduleFocus(NULL, 0);
+    scheduleArrange(selectedMonitor);
   }
   updateCurrentDesktop();
 }
@@ -276,8 +232,10 @@ void viewWorkspace(const Arg *arg) {
   if (arg->ui & WORKSPACEMASK)
     selectedMonitor->workspaceset[selectedMonitor->selectedWorkspaces] =
         arg->ui & WORKSPACEMASK;
-  focus(NULL);
-  arrange(selectedMonitor);
+  invalidateVisibleClients(selectedMonitor);
+  noteWorkspaceSwitch();
+  scheduleFocus(NULL, 0);
+  scheduleArrange(selectedMonitor);
   updateCurrentDesktop();
 }
 
@@ -287,8 +245,7 @@ void zoom(const Arg *arg) {
   if (!selectedMonitor->layouts[selectedMonitor->selectedLayout]->arrange ||
       !c || c->isFloating)
     return;
-  if (c == getNextTiledWindow(selectedMonitor->clients) &&
-      !(c = getNextTiledWindow(c->next)))
+  if (c == firstTiledClient(selectedMonitor) && !(c = c->nextVisible))
     return;
   pop(c);
 }
@@ -296,14 +253,15 @@ void zoom(const Arg *arg) {
 void pop(Client *c) {
   detach(c);
   attach(c);
-  focus(c);
-  arrange(c->monitor);
+  scheduleFocus(c, 0);
+  scheduleArrange(c->monitor);
 }
 
 void directWindowToMonitor(const Arg *arg) {
   if (!selectedMonitor->active || !monitors->next)
     return;
   sendWindowToMonitor(selectedMonitor->active, findMonitorInDirection(arg->i));
+  commitScheduled(); /* focusMonitor warps to the window's new geometry */
   focusMonitor(arg);
   moveCursorToClientCenter(selectedMonitor->active);
 }
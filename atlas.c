@@ -7,6 +7,7 @@
 #include <X11/extensions/Xinerama.h>
 #include <X11/keysym.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -20,6 +21,7 @@
 #include "atlas.h"
 #include "config.h"
 #include "ipc.h"
+#include "props.h"
 #include "util.h"
 
 /* variables */
@@ -42,12 +44,16 @@ DrawContext *drawContext;
 Atom wmAtoms[WM_ATOM_COUNT], netAtoms[NET_ATOM_COUNT];
 Window root, wmCheckWindow;
 CursorWrapper *cursor[CURSOR_COUNT];
+Clr borderColors[BORDER_COUNT];
 int isWMRunning = 1;
 
 Display *display;
 Monitor *monitors, *selectedMonitor;
 int screen, screenWidth, screenHeight;
 unsigned int numLockMask = 0;
+/* modifier combinations every grab is repeated with, so lock keys don't
+ * matter */
+unsigned int lockModifiers[4] = {0, LockMask, 0, LockMask};
 
 // Main Functions
 static int (*defaultXErrorHandler)(Display *, XErrorEvent *);
@@ -61,9 +67,17 @@ static void initCursors(void);
 static void initWMCheck(void);
 static void initWindowManager(void);
 int handleXError(Display *dpy, XErrorEvent *ee);
-int handleXErrorDummy(Display *dpy, XErrorEvent *ee);
 int handleXErrorStart(Display *dpy, XErrorEvent *ee);
 
+/* request serial ranges whose errors are expected, e.g. requests racing with a
+ * client destroying its window */
+typedef struct {
+  unsigned long first, last;
+} IgnoredRange;
+static IgnoredRange *ignoredRanges = NULL;
+static int ignoredRangeCount = 0;
+static int ignoredRangeCapacity = 0;
+
 void checkForOtherWM(void) {
   defaultXErrorHandler = XSetErrorHandler(handleXErrorStart);
   /* this causes an error if some other window manager is running */
@@ -80,54 +94,75 @@ void cleanupWindowManager(void) {
   size_t i;
 
   viewWorkspace(&a);
+  commitScheduled();
   selectedMonitor->layouts[selectedMonitor->selectedLayout] = &foo;
   for (m = monitors; m; m = m->next)
     while (m->stack)
       unmanage(m->stack, 0);
+  commitScheduled();
+  freeClientPool();
+  free(ignoredRanges);
   XUngrabKey(display, AnyKey, AnyModifier, root);
   while (monitors)
     cleanupMonitor(monitors);
   for (i = 0; i < CURSOR_COUNT; i++)
     drw_cur_free(drawContext, cursor[i]);
+  freeBorderColors();
   XDestroyWindow(display, wmCheckWindow);
   drw_free(drawContext);
   XSync(display, False);
   XSetInputFocus(display, PointerRoot, RevertToPointerRoot, CurrentTime);
   XDeleteProperty(display, root, netAtoms[NET_ACTIVE_WINDOW]);
+  cleanupEventLoop();
 }
 
 void runWindowManager(void) {
-  XEvent ev;
   XSync(display, False);
-
-  while (isWMRunning && !XNextEvent(display, &ev))
-    if (eventHandlers[ev.type])
-      eventHandlers[ev.type](&ev); /* call handler */
+  runEventLoop();
 }
 
+/* All queries go out before the first reply is read, so adopting hundreds of
+ * windows costs about one round-trip instead of several per window. manage()
+ * only schedules arranging, the commit at the end arranges each monitor once.
+ */
 void scan(void) {
   unsigned int i, num;
   Window d1, d2, *wins = NULL;
-  XWindowAttributes wa;
-
-  if (XQueryTree(display, root, &d1, &d2, &wins, &num)) {
-    for (i = 0; i < num; i++) {
-      if (!XGetWindowAttributes(display, wins[i], &wa) ||
-          wa.override_redirect || XGetTransientForHint(display, wins[i], &d1))
-        continue;
-      if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-        manage(wins[i], &wa);
-    }
-    for (i = 0; i < num; i++) { /* now the transients */
-      if (!XGetWindowAttributes(display, wins[i], &wa))
-        continue;
-      if (XGetTransientForHint(display, wins[i], &d1) &&
-          (wa.map_state == IsViewable || getstate(wins[i]) == IconicState))
-        manage(wins[i], &wa);
-    }
+  WindowQuery *queries;
+  WindowInfo *infos;
+  char *adopt;
+
+  if (!XQueryTree(display, root, &d1, &d2, &wins, &num))
+    return;
+  if (num == 0) {
     if (wins)
       XFree(wins);
+    return;
   }
+
+  queries = ecalloc(num, sizeof(WindowQuery));
+  infos = ecalloc(num, sizeof(WindowInfo));
+  adopt = ecalloc(num, sizeof(char));
+  for (i = 0; i < num; i++)
+    queryWindow(wins[i], &queries[i]);
+  for (i = 0; i < num; i++)
+    adopt[i] = collectWindowInfo(&queries[i], &infos[i]) &&
+               !infos[i].overrideRedirect &&
+               (infos[i].mapState == IsViewable ||
+                infos[i].wmState == IconicState);
+
+  for (i = 0; i < num; i++)
+    if (adopt[i] && infos[i].transientFor == None)
+      manage(wins[i], &infos[i]);
+  for (i = 0; i < num; i++) /* now the transients */
+    if (adopt[i] && infos[i].transientFor != None)
+      manage(wins[i], &infos[i]);
+
+  free(adopt);
+  free(infos);
+  free(queries);
+  XFree(wins);
+  commitScheduled();
 }
 
 void startupPrograms(void) {
@@ -142,33 +177,10 @@ void startupPrograms(void) {
       continue;
     }
 
-    pid_t pid = fork();
-    if (pid == -1) {
-      LOG_ERROR("Failed to fork for '%s': %s", prog->command, strerror(errno));
+    pid_t pid = launchProgram(prog->args);
+    if (pid == -1)
       continue;
-    }
 
-    if (pid == 0) { // Child process
-      // Close X connection in child
-      if (display) {
-        close(ConnectionNumber(display));
-      }
-
-      // Create new session
-      if (setsid() == -1) {
-        LOG_ERROR("setsid failed for '%s': %s", prog->command, strerror(errno));
-        exit(EXIT_FAILURE);
-      }
-
-      // Execute the program
-      execvp(prog->command, prog->args);
-
-      // If we get here, execvp failed
-      LOG_ERROR("Failed to execute '%s': %s", prog->command, strerror(errno));
-      exit(EXIT_FAILURE);
-    }
-
-    // Parent process
     LOG_INFO("Started program: %s (pid: %d)", prog->command, pid);
   }
 }
@@ -200,6 +212,8 @@ void initAtoms(void) {
       XInternAtom(display, "_NET_SUPPORTING_WM_CHECK", False);
   netAtoms[NET_WM_FULLSCREEN] =
       XInternAtom(display, "_NET_WM_STATE_FULLSCREEN", False);
+  netAtoms[NET_WM_HIDDEN] =
+      XInternAtom(display, "_NET_WM_STATE_HIDDEN", False);
   netAtoms[NET_WM_WINDOW_TYPE] =
       XInternAtom(display, "_NET_WM_WINDOW_TYPE", False);
   netAtoms[NET_WM_WINDOW_TYPE_DIALOG] =
@@ -258,12 +272,16 @@ void initWindowManager(void) {
   root = RootWindow(display, screen);
 
   drawContext = drw_create(display, screen, root, screenWidth, screenHeight);
+  /* programs we launch must not inherit the X connection */
+  fcntl(ConnectionNumber(display), F_SETFD, FD_CLOEXEC);
 
   updateMonitorGeometry();
   initAtoms();
   initCursors();
+  loadBorderColors();
   initWMCheck();
   setup_ipc(display);
+  setupEventLoop();
 
   XChangeProperty(display, root, netAtoms[NET_SUPPORTED], XA_ATOM, 32,
                   PropModeReplace, (unsigned char *)netAtoms, NET_ATOM_COUNT);
@@ -284,6 +302,7 @@ void initWindowManager(void) {
   XSelectInput(display, root, wa.event_mask);
 
   // Register keyboard shortcuts
+  updateNumlockMask();
   registerKeyboardShortcuts();
   Monitor *m;
   for (m = monitors; m; m = m->next) {
@@ -293,11 +312,59 @@ void initWindowManager(void) {
   startupPrograms();
 }
 
+/* Errors for requests issued between startIgnoringXErrors() and
+ * stopIgnoringXErrors() are dropped by serial number once they arrive, so no
+ * XSync is needed to find out whether the requests failed. */
+unsigned long startIgnoringXErrors(void) { return NextRequest(display); }
+
+void stopIgnoringXErrors(unsigned long first) {
+  unsigned long processed = LastKnownRequestProcessed(display);
+  unsigned long last = NextRequest(display) - 1;
+  IgnoredRange *ranges;
+  int i, n = 0, capacity;
+
+  if (last < first)
+    return;
+  /* ranges the server is past had their errors delivered already */
+  for (i = 0; i < ignoredRangeCount; i++)
+    if (ignoredRanges[i].last > processed)
+      ignoredRanges[n++] = ignoredRanges[i];
+  ignoredRangeCount = n;
+  /* back to back ranges, like a burst of unmanages, become one */
+  if (n && first <= ignoredRanges[n - 1].last + 1) {
+    ignoredRanges[n - 1].last = last;
+    return;
+  }
+  if (n == ignoredRangeCapacity) {
+    capacity = n ? n * 2 : 32;
+    if (!(ranges = realloc(ignoredRanges, capacity * sizeof *ranges))) {
+      /* never drop a range; ignoring the requests in between is the lesser
+       * harm */
+      LOG_ERROR("Failed to allocate memory for ignored X error ranges");
+      if (n)
+        ignoredRanges[n - 1].last = last;
+      return;
+    }
+    ignoredRanges = ranges;
+    ignoredRangeCapacity = capacity;
+  }
+  ignoredRanges[n].first = first;
+  ignoredRanges[n].last = last;
+  ignoredRangeCount = n + 1;
+}
+
+static int isIgnoredXError(unsigned long serial) {
+  for (int i = 0; i < ignoredRangeCount; i++)
+    if (serial >= ignoredRanges[i].first && serial <= ignoredRanges[i].last)
+      return 1;
+  return 0;
+}
+
 /* There's no way to check accesses to destroyed windows, thus those cases are
  * ignored (especially on UnmapNotify's). Other types of errors call Xlibs
  * default error handler, which may call exit. */
 int handleXError(Display *dpy, XErrorEvent *ee) {
-  if (ee->error_code == BadWindow ||
+  if (isIgnoredXError(ee->serial) || ee->error_code == BadWindow ||
       (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch) ||
       (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable) ||
       (ee->request_code == X_PolyFillRectangle &&
@@ -319,8 +386,6 @@ int handleXError(Display *dpy, XErrorEvent *ee) {
   return defaultXErrorHandler(dpy, ee);
 }
 
-int handleXErrorDummy(Display *dpy, XErrorEvent *ee) { return 0; }
-
 int handleXErrorStart(Display *dpy, XErrorEvent *ee) {
   LOG_FATAL("Another window manager is already running");
   return -1;
@@ -341,8 +406,19 @@ int main(int argc, char *argv[]) {
       XCloseDisplay(d);
       return success ? 0 : 1;
 
+    } else if (strcmp(argv[1], "stats") == 0) {
+      Display *d = XOpenDisplay(NULL);
+      if (!d) {
+        LOG_ERROR("Cannot open display");
+        return 1;
+      }
+
+      int success = send_command(d, CMD_STATS);
+      XCloseDisplay(d);
+      return success ? 0 : 1;
+
     } else {
-      die("Usage: atlaswm [-v|reload]");
+      die("Usage: atlaswm [-v|reload|stats]");
     }
   } else if (argc != 1)
     die("Usage: atlaswm [-v]");
@@ -357,6 +433,7 @@ int main(int argc, char *argv[]) {
   scan();
   runWindowManager();
   LOG_INFO("AtlasWM is exiting");
+  logEventStats();
   cleanupWindowManager();
   XCloseDisplay(display);
   return EXIT_SUCCESS;
@@ -3,13 +3,22 @@
 
 #include <X11/Xft/Xft.h>
 #include <X11/Xlib.h>
+#include <X11/Xutil.h>
 
 /* Forward Declarations */
 typedef struct Monitor Monitor;
 typedef struct Client Client;
 
 // Constants and Enums
+#define MAX_WORKSPACES 32 /* workspace masks are unsigned ints */
 enum CursorType { CURSOR_NORMAL, CURSOR_RESIZE, CURSOR_MOVE, CURSOR_COUNT };
+enum BorderColor {
+  BORDER_ACTIVE,
+  BORDER_INACTIVE,
+  BORDER_URGENT,
+  BORDER_FLOATING,
+  BORDER_COUNT
+};
 
 enum NetAtom {
   NET_SUPPORTED,
@@ -17,6 +26,7 @@ enum NetAtom {
   NET_WM_STATE,
   NET_WM_CHECK,
   NET_WM_FULLSCREEN,
+  NET_WM_HIDDEN,
   NET_ACTIVE_WINDOW,
   NET_WM_WINDOW_TYPE,
   NET_WM_WINDOW_TYPE_DIALOG,
@@ -30,8 +40,14 @@ enum NetAtom {
 
 enum WMAtom { WM_PROTOCOLS, WM_DELETE, WM_STATE, WM_TAKE_FOCUS, WM_ATOM_COUNT };
 
+// WM_PROTOCOLS a client supports
+enum Protocol { PROTOCOL_DELETE = 1 << 0, PROTOCOL_TAKE_FOCUS = 1 << 1 };
+
 enum ClickTarget { CLICK_CLIENT_WINDOW, CLICK_ROOT_WINDOW, CLICK_COUNT };
 
+// Lists of visible clients a monitor keeps, see relinkVisibleClient()
+enum VisibleList { VISIBLE_TILED, VISIBLE_FLOATING, VISIBLE_NONE };
+
 typedef enum {
   ACTION_SPAWN,
   ACTION_RELOAD,
@@ -52,6 +68,24 @@ typedef enum {
 enum MonitorDirection { DIR_UP = 1, DIR_DOWN = 2, DIR_LEFT = 3, DIR_RIGHT = 4 };
 
 /* Data Structures */
+typedef void (*LoopCallback)(int fd, void *data);
+
+// Event loop counters, see logEventStats()
+typedef struct {
+  unsigned long batches;            // Wakeups that dispatched any event
+  unsigned long events;             // Events read from the X queue
+  unsigned long collapsed;          // Events dropped as redundant
+  unsigned long roundTrips;         // Requests we waited on a reply for
+  unsigned long maxRoundTrips;      // Most round-trips a single event caused
+  unsigned long commitRoundTrips;   // Round-trips in the commit phase
+  unsigned long workspaceSwitches;  // Workspace views and toggles
+  unsigned long switchRequests;     // X requests those switches caused
+  unsigned long layoutsReused;      // Arranges served from a LayoutCache
+  unsigned long suppressedRequests; // Writes the server already had
+  unsigned long eventsByType[LASTEvent];     // Dispatched events per type
+  unsigned long roundTripsByType[LASTEvent]; // Round-trips per event type
+} EventStats;
+
 typedef union {
   int i;
   unsigned int ui;
@@ -80,6 +114,7 @@ typedef struct {
   ActionType action;
   char *value;
   char *description;
+  Arg arg; // value compiled at load time: argv, workspace mask or direction
 } Keybinding;
 
 typedef struct {
@@ -120,29 +155,113 @@ typedef struct {
   GC gc;             // Graphics context
 } DrawContext;
 
-// Client (window) structure
-struct Client {
+// Client properties kept until a PropertyNotify says they changed
+enum CachedProp {
+  PROP_PROTOCOLS = 1 << 0,    // WM_PROTOCOLS
+  PROP_HINTS = 1 << 1,        // WM_HINTS
+  PROP_NORMAL_HINTS = 1 << 2, // WM_NORMAL_HINTS
+  PROP_CLASS = 1 << 3,        // WM_CLASS
+  PROP_WINDOW_TYPE = 1 << 4,  // _NET_WM_WINDOW_TYPE
+  PROP_STATE = 1 << 5,        // _NET_WM_STATE
+  PROP_ALL = (1 << 6) - 1
+};
+
+#define MAX_NET_STATES 16 /* _NET_WM_STATE atoms read from a window */
+
+typedef struct {
+  unsigned int valid;             // CachedProp bits that are up to date
+  unsigned int protocols;         // Protocol bits from WM_PROTOCOLS
+  int hasWMHints;                 // Whether wmHints is set
+  XWMHints wmHints;               // WM_HINTS
+  XSizeHints sizeHints;           // WM_NORMAL_HINTS, flags PSize if unset
+  char class[64], instance[64];   // WM_CLASS, empty if unset
+  Atom windowType;                // First atom of _NET_WM_WINDOW_TYPE
+  Atom netState;                  // First atom of _NET_WM_STATE
+  Atom netStates[MAX_NET_STATES]; // All atoms of _NET_WM_STATE
+  unsigned int netStateCount;     // Atoms in netStates
+} PropCache;
+
+// What manage() needs to know about a window, fetched in one go
+typedef struct {
+  int x, y, width, height, borderWidth; // Geometry
+  int overrideRedirect;                 // Whether the window bypasses us
+  int mapState;                         // IsUnmapped, IsUnviewable, IsViewable
+  long wmState;                         // WM_STATE, -1 if unset
+  Window transientFor;                  // WM_TRANSIENT_FOR, None if unset
+  char name[256];                       // Title, empty if unset
+  PropCache props;                      // Seeds the client's cache
+} WindowInfo;
+
+// Button grabs a client window has, see buttonGrabsChanged()
+enum { GRABS_NONE, GRABS_FOCUSED, GRABS_UNFOCUSED };
+
+// _NET_WM_STATE atoms we manage, see updateNetWMState()
+enum { NET_STATE_FULLSCREEN = 1 << 0, NET_STATE_HIDDEN = 1 << 1 };
+
+// What the server has for a managed window, see shadow.c
+typedef struct {
+  int x, y, w, h, borderWidth;      // Geometry
+  unsigned long borderPixel;        // Border color
+  int hasBorderPixel;               // Whether borderPixel was set by us yet
+  int mapped;                       // Whether the window is mapped
+  int grabs;                        // GRABS_* state of the button grabs
+  unsigned int grabLocks;           // numLockMask the grabs were made with
+  Atom otherStates[MAX_NET_STATES]; // _NET_WM_STATE atoms we do not manage
+  unsigned int otherStateCount;     // Atoms in otherStates
+  int netState;                     // NET_STATE_* bits last written, or -1
+} WindowShadow;
+
+// Client data only needed by property updates, size hints, fullscreen and
+// requests to the window, kept apart so list walks only touch struct Client
+typedef struct {
   char name[256];                       // Window title
   float minAspectRatio, maxAspectRatio; // Window aspect ratio constraints
-  int x, y, w, h;                       // Current geometry
-  int oldx, oldy, oldw, oldh;           // Previous geometry
-  float horizontalRatio, verticalRatio; // Position ratios
   int basew, baseh;                     // Minimum size
   int incw, inch;                       // Increment size
   int maxw, maxh, minw, minh;           // Size constraints
-  int hintsvalid;                       // Whether size hints are valid
-  int borderWidth, oldBorderWidth;      // Border widths
-  unsigned int workspaces;              // Tags (virtual desktops)
-  int isFixedSize;                      // Whether size is fixed
-  int isFloating;                       // Whether window is floating
-  int isUrgent;                         // Whether window needs attention
-  int neverFocus;                       // Whether window should never get focus
-  int previousState;                    // Previous state
-  int isFullscreen;                     // Whether window is fullscreen
-  Client *next;                         // Next client in list
-  Client *nextInStack;                  // Next client in stack
-  Monitor *monitor;                     // Monitor containing this client
-  Window win;                           // X11 window ID
+  int oldx, oldy, oldw, oldh;           // Previous geometry
+  int oldBorderWidth;                   // Border width before we managed it
+  PropCache props;                      // Cached ICCCM/EWMH properties
+  WindowShadow shadow;                  // What the server has, see shadow.c
+} ClientCold;
+
+// Client (window) structure, allocated from the pool in client.c
+struct Client {
+  int x, y, w, h;                    // Current geometry
+  int borderWidth;                   // Border width
+  unsigned int workspaces;           // Tags (virtual desktops)
+  int isFixedSize;                   // Whether size is fixed
+  int isFloating;                    // Whether window is floating
+  int isUrgent;                      // Whether window needs attention
+  int neverFocus;                    // Whether window should never get focus
+  int previousState;                 // Previous state
+  int isFullscreen;                  // Whether window is fullscreen
+  int isShown;                       // Whether moved on screen by us
+  int isHidden;                      // Whether unmapped by us to hide it
+  int isOccluded;                    // Whether covered by monocle/fullscreen
+  int ignoreUnmap;                   // UnmapNotify events we caused
+  unsigned int dwindleTrees;         // Dwindle trees of its monitor holding it
+  Client *next, *prev;               // Neighbours in client list
+  Client *nextInStack, *prevInStack; // Neighbours in stack
+  Client *nextVisible, *prevVisible; // Neighbours in its visible list
+  int visibleList;                   // VisibleList it is on
+  Monitor *monitor;                  // Monitor containing this client
+  Window win;                        // X11 window ID
+  ClientCold *cold;                  // Rarely used data, see ClientCold
+};
+
+// Node of a monitor's dwindle split tree, leaves hold one client each
+typedef struct DwindleNode DwindleNode;
+struct DwindleNode {
+  DwindleNode *parent;         // Split above, NULL at the root
+  DwindleNode *first, *second; // Children, NULL for leaves
+  Client *client;              // Client of a leaf
+  int vertical;                // Whether the children sit side by side
+  float ratio;                 // Share of the area given to first
+  int tiled;                   // Tiled clients below, floating ones get no area
+  int dirty;                   // Whether the next layout must split it again
+  int gaps;                    // Inner gaps of the last layout
+  int x, y, w, h;              // Area from the last layout
 };
 
 // Layout structure
@@ -151,21 +270,55 @@ typedef struct {
   void (*arrange)(Monitor *); // Layout arrangement function
 } Layout;
 
+// Where a layout wants a client, border included, see placeClient()
+typedef struct {
+  Client *client;
+  int x, y, w, h;
+} LayoutSlot;
+
+// Layout result for one workspace, reused while nothing it depends on changed
+typedef struct {
+  unsigned int view;         // View it was computed for
+  const Layout *layout;      // Layout that computed it
+  int wx, wy, ww, wh;        // Window area it was computed for
+  Client *top;               // Window monocle showed on top, NULL otherwise
+  char layoutSymbol[16];     // Symbol the layout set
+  LayoutSlot *slots;         // Copy of the slots
+  unsigned int slotCount;    // Slots in use
+  unsigned int slotCapacity; // Slots allocated
+} LayoutCache;
+
 // Monitor structure
 struct Monitor {
-  char layoutSymbol[16];           // Current layout symbol
-  float masterFactor;              // Size of master area
-  int num;                         // Monitor number
-  int mx, my, mw, mh;              // Monitor geometry
-  int wx, wy, ww, wh;              // Window area geometry
-  unsigned int selectedWorkspaces; // Current workspace selection
-  unsigned int selectedLayout;     // Current layout
-  unsigned int workspaceset[2];    // Workspace sets
-  Client *clients;                 // List of clients
-  Client *active;                  // Selected client
-  Client *stack;                   // Client stack
-  Monitor *next;                   // Next monitor
-  const Layout *layouts[2];        // Available layouts
+  char layoutSymbol[16];                // Current layout symbol
+  float masterFactor;                   // Size of master area
+  int num;                              // Monitor number
+  int mx, my, mw, mh;                   // Monitor geometry
+  int wx, wy, ww, wh;                   // Window area geometry
+  unsigned int selectedWorkspaces;      // Current workspace selection
+  unsigned int selectedLayout;          // Current layout
+  unsigned int workspaceset[2];         // Workspace sets
+  Client *clients;                      // List of clients
+  Client *lastClient;                   // Tail of clients
+  Client *active;                       // Selected client
+  Client *stack;                        // Client stack
+  Client *stackBottom;                  // Tail of stack
+  Client *visible[VISIBLE_NONE];        // Visible clients in client order
+  Client *lastVisible[VISIBLE_NONE];    // Tails of visible
+  int visibleDirty;                     // Whether visible needs a rebuild
+  int shownDirty;                       // Whether shown states need a check
+  int needsArrange;                     // Arrange pending for the commit phase
+  LayoutSlot *slots;                    // Targets of the last layout run
+  unsigned int slotCount;               // Slots filled by the last layout run
+  unsigned int slotCapacity;            // Slots allocated
+  DwindleNode *dwindle[MAX_WORKSPACES]; // Split trees by workspace
+  LayoutCache *layoutCache;             // Per workspace, by lowest view bit
+  unsigned int layoutValid;             // Workspaces with a current layoutCache
+  Window *stackOrder;                   // Tiled windows as last restacked
+  unsigned int stackCount;              // Windows in stackOrder
+  unsigned int stackCapacity;           // Windows allocated
+  Monitor *next;                        // Next monitor
+  const Layout *layouts[2];             // Available layouts
 };
 
 /* Drawing Functions */
@@ -173,6 +326,7 @@ DrawContext *drw_create(Display *dpy, int screen, Window win, unsigned int w,
                         unsigned int h);
 void drw_free(DrawContext *drw);
 void drw_clr_create(DrawContext *drw, Clr *dest, const char *clrname);
+void drw_clr_free(DrawContext *drw, Clr *clr);
 CursorWrapper *drw_cur_create(DrawContext *drw, int shape);
 void drw_cur_free(DrawContext *drw, CursorWrapper *cursor);
 
@@ -201,33 +355,58 @@ void drw_cur_free(DrawContext *drw, CursorWrapper *cursor);
 
 /* Function Declarations */
 // Window Functions
-void manage(Window w, XWindowAttributes *wa);
+void manage(Window w, WindowInfo *info);
 void unmanage(Client *c, int destroyed);
 void updateWindowTitle(Client *c);
 void updateWindowTypeProps(Client *c);
 void updateWindowManagerHints(Client *c);
 void updateWindowSizeHints(Client *c);
+void applyWindowTypeProps(Client *c, Atom state, Atom wtype);
+void applyWindowManagerHints(Client *c, XWMHints *wmh);
+void applyWindowSizeHints(Client *c, XSizeHints *size);
 void configure(Client *c);
-void applyWindowRules(Client *c);
+void applyWindowRules(Client *c, const char *class, const char *instance);
 int applyWindowSizeConstraints(Client *c, int *x, int *y, int *w, int *h,
                                int interact);
 void setWindowFullscreen(Client *c, int fullscreen);
 void setWindowUrgent(Client *c, int urg);
 void toggleWindowFloating(const Arg *arg);
-void toggleWindowVisibility(Client *c);
+void updateWindowVisibility(Monitor *m);
+void showWindow(Client *c);
+void hideWindow(Client *c);
+void updateNetWMState(Client *c);
 void resize(Client *c, int x, int y, int w, int h, int interact);
 void resizeclient(Client *c, int x, int y, int w, int h);
 void setclientstate(Client *c, long state);
 int sendevent(Client *c, Atom proto);
 int shouldscale(Client *c);
 void scaleclient(Client *c, int x, int y, int w, int h, float scale);
-Atom getatomprop(Client *c, Atom prop);
-long getstate(Window w);
-int gettextprop(Window w, Atom atom, char *text, unsigned int size);
+
+// Shadow Functions
+void seedWindowShadow(Client *c, WindowInfo *info);
+int configureWindow(Client *c, int x, int y, int w, int h, int borderWidth);
+int moveWindowTo(Client *c, int x, int y);
+int setWindowBorderWidth(Client *c, int borderWidth);
+void setWindowBorderPixel(Client *c, unsigned long pixel);
+int mapWindow(Client *c);
+int unmapWindow(Client *c);
+int buttonGrabsChanged(Client *c, int focused);
+void verifyWindowShadows(void);
+
+// Property Functions
+void invalidateWindowProps(Client *c, Atom atom);
+void refreshWindowProps(Client *c, unsigned int which);
+unsigned int getWindowProtocols(Client *c);
+XWMHints *getWindowManagerHints(Client *c);
+XSizeHints *getWindowSizeHints(Client *c);
+void fetchWindowTitle(Window w, char *text, size_t size);
 
 // Focus Functions
 void focus(Client *c);
 void unfocus(Client *c, int setfocus);
+void loadBorderColors(void);
+void freeBorderColors(void);
+void setClientBorder(Client *c, int active);
 void focusstack(const Arg *arg);
 void focusMonitor(const Arg *arg);
 void setfocus(Client *c);
@@ -243,12 +422,21 @@ Monitor *getMonitorForArea(int x, int y, int w, int h);
 void sendWindowToMonitor(Client *c, Monitor *m);
 
 // Client Functions
+Client *allocClient(void);
+void freeClient(Client *c);
+void freeClientPool(void);
 void attach(Client *c);
 void detach(Client *c);
 void attachWindowToStack(Client *c);
 void detachWindowFromStack(Client *c);
 Client *findClientFromWindow(Window w);
-Client *getNextTiledWindow(Client *c);
+void verifyClientIndex(void);
+Client *firstTiledClient(Monitor *m);
+Client *firstFloatingClient(Monitor *m);
+Client *firstVisibleClient(Monitor *m);
+Client *nextVisibleClient(Client *c);
+void relinkVisibleClient(Client *c);
+void invalidateVisibleClients(Monitor *m);
 void updateClientList(void);
 
 // Event Handling Functions
@@ -267,18 +455,24 @@ void handleKeypress(XEvent *e);
 void handleWindowConfigChange(XEvent *e);
 
 // Layout Functions
-void arrange(Monitor *m);
 void arrangeMonitor(Monitor *m);
 void setlayout(const Arg *arg);
 void setMasterRatio(const Arg *arg);
+void placeClient(Monitor *m, Client *c, int x, int y, int w, int h);
+void applyLayout(Monitor *m);
+void invalidateLayout(Monitor *m, unsigned int workspaces);
 void monocle(Monitor *m);
 void dwindlegaps(Monitor *m);
+void removeDwindleClient(Client *c);
+void resizeDwindleSplit(Client *c, int x, int y, int hCorner, int vCorner);
 void restack(Monitor *m);
+void updateOcclusion(Monitor *m);
 
 // Input Handling Functions
 void registerMouseButtons(Client *c, int focused);
 void registerKeyboardShortcuts(void);
-void updateNumlockMask(void);
+Keybinding *findKeybinding(KeyCode code, unsigned int state);
+int updateNumlockMask(void);
 void moveWindow(const Arg *arg);
 void resizeWindow(const Arg *arg);
 int getRootPointer(int *x, int *y);
@@ -288,6 +482,7 @@ void executeKeybinding(Keybinding *kb);
 void killclient(const Arg *arg);
 void quit(const Arg *arg);
 void spawn(const Arg *arg);
+pid_t launchProgram(char *const argv[]);
 void moveToWorkspace(const Arg *arg);
 void duplicateToWorkspace(const Arg *arg);
 void toggleWorkspace(const Arg *arg);
@@ -298,9 +493,28 @@ void directWindowToMonitor(const Arg *arg);
 void free_command_args(char **argv);
 char **parse_command_string(const char *cmd);
 
+// Event Loop Functions
+void setupEventLoop(void);
+void cleanupEventLoop(void);
+void runEventLoop(void);
+int watchLoopFd(int fd, LoopCallback cb, void *data);
+void unwatchLoopFd(int fd);
+int createLoopTimer(LoopCallback cb, void *data);
+void armLoopTimer(int fd, unsigned int ms);
+void destroyLoopTimer(int fd);
+void logEventStats(void);
+void noteRoundTrip(unsigned long serial);
+void scheduleArrange(Monitor *m);
+void scheduleFocus(Client *c, int warp);
+void scheduleClientListUpdate(void);
+void noteWorkspaceSwitch(void);
+void forgetScheduled(Client *c);
+void commitScheduled(void);
+
 int handleXError(Display *dpy, XErrorEvent *ee);
-int handleXErrorDummy(Display *dpy, XErrorEvent *ee);
 int handleXErrorStart(Display *dpy, XErrorEvent *ee);
+unsigned long startIgnoringXErrors(void);
+void stopIgnoringXErrors(unsigned long first);
 
 void setCurrentDesktop(void);
 void setDesktopNames(void);
@@ -314,13 +528,17 @@ extern Monitor *monitors;
 extern Monitor *selectedMonitor;
 extern DrawContext *drawContext;
 extern CursorWrapper *cursor[CURSOR_COUNT];
+extern Clr borderColors[BORDER_COUNT];
 extern Window root;
 extern Atom wmAtoms[WM_ATOM_COUNT], netAtoms[NET_ATOM_COUNT];
 extern unsigned int numLockMask;
+extern unsigned int lockModifiers[4];
 extern int screenWidth, screenHeight;
 extern int screen;
 extern const Layout layouts[];
 extern void (*eventHandlers[LASTEvent])(XEvent *);
 extern int isWMRunning;
+extern EventStats eventStats;
+extern unsigned long enterIgnoreSerial;
 
 #endif // _ATLASWM_H_
@@ -1,79 +1,395 @@
 #include "atlas.h"
 #include "config.h"
+#include "util.h"
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <stdlib.h>
 #include <string.h>
 
-void attach(Client *c) {
-  if (!c->monitor->clients) {
-    // If there are no clients, this becomes the first one
-    c->monitor->clients = c;
-    c->next = NULL;
+/* Clients come from slabs of CLIENT_SLAB_SIZE, with the hot structs packed
+ * together and their cold halves after them, so walking the client lists
+ * stays within a few cache lines per client. Freed clients go on a free list
+ * linked through next; slabs are only released at exit. */
+#define CLIENT_SLAB_SIZE 64
+
+typedef struct ClientSlab ClientSlab;
+struct ClientSlab {
+  Client hot[CLIENT_SLAB_SIZE];
+  ClientCold cold[CLIENT_SLAB_SIZE];
+  ClientSlab *next;
+};
+
+static ClientSlab *clientSlabs = NULL;
+static Client *freeClients = NULL;
+
+static void growClientPool(void) {
+  ClientSlab *slab = ecalloc(1, sizeof(ClientSlab));
+  int i;
+
+  slab->next = clientSlabs;
+  clientSlabs = slab;
+  /* push in reverse so clients are handed out in address order */
+  for (i = CLIENT_SLAB_SIZE - 1; i >= 0; i--) {
+    slab->hot[i].cold = &slab->cold[i];
+    slab->hot[i].next = freeClients;
+    freeClients = &slab->hot[i];
+  }
+}
+
+/* Returns a zeroed client with its cold data attached */
+Client *allocClient(void) {
+  Client *c;
+  ClientCold *cold;
+
+  if (!freeClients)
+    growClientPool();
+  c = freeClients;
+  freeClients = c->next;
+  cold = c->cold;
+  memset(c, 0, sizeof *c);
+  memset(cold, 0, sizeof *cold);
+  c->cold = cold;
+  return c;
+}
+
+void freeClient(Client *c) {
+  c->next = freeClients;
+  freeClients = c;
+}
+
+void freeClientPool(void) {
+  ClientSlab *slab;
+
+  while ((slab = clientSlabs)) {
+    clientSlabs = slab->next;
+    free(slab);
+  }
+  freeClients = NULL;
+}
+
+/* Open addressing index from X window to client, with linear probing. It holds
+ * every attached client and lets event handlers find their client without
+ * walking each monitor's list. */
+static Client **clientIndex = NULL;
+static size_t indexCapacity = 0;
+static unsigned int indexBits = 0; // log2 of indexCapacity
+static size_t indexCount = 0;
+
+static size_t indexSlot(Window w) {
+  /* Fibonacci hashing spreads the sequential ids X hands out; the top bits
+   * of the 64-bit product are the well mixed ones */
+  return (size_t)((w * 11400714819323198485ull) >> (64 - indexBits));
+}
+
+static void insertIndexed(Client *c) {
+  size_t i;
+
+  for (i = indexSlot(c->win); clientIndex[i]; i = (i + 1) & (indexCapacity - 1))
+    if (clientIndex[i]->win == c->win) {
+      clientIndex[i] = c;
+      return;
+    }
+  clientIndex[i] = c;
+  indexCount++;
+}
+
+static void growClientIndex(void) {
+  Client **old = clientIndex;
+  size_t i, oldCapacity = indexCapacity;
+
+  indexCapacity = oldCapacity ? oldCapacity * 2 : 64;
+  indexBits = oldCapacity ? indexBits + 1 : 6;
+  clientIndex = ecalloc(indexCapacity, sizeof(Client *));
+  indexCount = 0;
+  for (i = 0; i < oldCapacity; i++)
+    if (old[i])
+      insertIndexed(old[i]);
+  free(old);
+}
+
+static void indexClient(Client *c) {
+  /* keep the load factor at or below one half */
+  if ((indexCount + 1) * 2 > indexCapacity)
+    growClientIndex();
+  insertIndexed(c);
+}
+
+static void unindexClient(Client *c) {
+  size_t i, j, home;
+
+  if (!indexCapacity)
+    return;
+  for (i = indexSlot(c->win); clientIndex[i] && clientIndex[i] != c;
+       i = (i + 1) & (indexCapacity - 1))
+    ;
+  if (!clientIndex[i])
     return;
+  clientIndex[i] = NULL;
+  indexCount--;
+
+  /* shift back later entries of the probe run that could have used the slot */
+  for (j = (i + 1) & (indexCapacity - 1); clientIndex[j];
+       j = (j + 1) & (indexCapacity - 1)) {
+    home = indexSlot(clientIndex[j]->win);
+    if (((j - home) & (indexCapacity - 1)) >= ((j - i) & (indexCapacity - 1))) {
+      clientIndex[i] = clientIndex[j];
+      clientIndex[j] = NULL;
+      i = j;
+    }
+  }
+}
+
+/* Compares the index against the monitor lists and checks the list links,
+ * only in debug builds since it walks every client */
+void verifyClientIndex(void) {
+#ifdef ATLASWM_DEBUG
+  Client *c, *prev;
+  Monitor *m;
+  size_t n = 0;
+
+  for (m = monitors; m; m = m->next) {
+    for (prev = NULL, c = m->clients; c; prev = c, c = c->next, n++) {
+      if (findClientFromWindow(c->win) != c)
+        LOG_ERROR("Client index lost window 0x%lx", c->win);
+      if (c->prev != prev)
+        LOG_ERROR("Client list broken at window 0x%lx", c->win);
+    }
+    if (m->lastClient != prev)
+      LOG_ERROR("Client list tail is not the last client");
+    for (prev = NULL, c = m->stack; c; prev = c, c = c->nextInStack)
+      if (c->prevInStack != prev)
+        LOG_ERROR("Client stack broken at window 0x%lx", c->win);
+    if (m->stackBottom != prev)
+      LOG_ERROR("Client stack tail is not the bottom client");
+  }
+  if (n != indexCount)
+    LOG_ERROR("Client index holds %zu clients, lists hold %zu", indexCount, n);
+#endif
+}
+
+/* Each monitor keeps the tiled and the floating clients of its view on two
+ * lists, in client order and linked through nextVisible and prevVisible.
+ * attach, detach and relinkVisibleClient() update them one client at a time;
+ * only a view change rebuilds them, see invalidateVisibleClients() */
+
+static void unlinkVisible(Client *c) {
+  Monitor *m = c->monitor;
+  int l = c->visibleList;
+
+  /* a pending rebuild drops the old links anyway */
+  if (l != VISIBLE_NONE && !m->visibleDirty) {
+    if (c->prevVisible)
+      c->prevVisible->nextVisible = c->nextVisible;
+    else
+      m->visible[l] = c->nextVisible;
+    if (c->nextVisible)
+      c->nextVisible->prevVisible = c->prevVisible;
+    else
+      m->lastVisible[l] = c->prevVisible;
   }
+  c->nextVisible = c->prevVisible = NULL;
+  c->visibleList = VISIBLE_NONE;
+}
+
+/* Inserts c after the closest client before it on list l, which is the tail
+ * for a client just attached */
+static void linkVisible(Client *c, int l) {
+  Monitor *m = c->monitor;
+  Client *p;
 
-  // Find the last client
-  Client *last;
-  for (last = c->monitor->clients; last->next; last = last->next)
+  for (p = c->prev; p && p->visibleList != l; p = p->prev)
     ;
+  c->prevVisible = p;
+  c->nextVisible = p ? p->nextVisible : m->visible[l];
+  if (c->nextVisible)
+    c->nextVisible->prevVisible = c;
+  else
+    m->lastVisible[l] = c;
+  if (p)
+    p->nextVisible = c;
+  else
+    m->visible[l] = c;
+  c->visibleList = l;
+}
+
+static void rebuildVisibleClients(Monitor *m) {
+  Client *c;
+  int l;
+
+  for (l = 0; l < VISIBLE_NONE; l++)
+    m->visible[l] = m->lastVisible[l] = NULL;
+  for (c = m->clients; c; c = c->next) {
+    c->nextVisible = c->prevVisible = NULL;
+    c->visibleList = l = !ISVISIBLE(c)   ? VISIBLE_NONE
+                         : c->isFloating ? VISIBLE_FLOATING
+                                         : VISIBLE_TILED;
+    if (l == VISIBLE_NONE)
+      continue;
+    if ((c->prevVisible = m->lastVisible[l]))
+      c->prevVisible->nextVisible = c;
+    else
+      m->visible[l] = c;
+    m->lastVisible[l] = c;
+  }
+  m->visibleDirty = 0;
+}
+
+/* Moves c to the list it belongs on, call after changing its workspaces or
+ * floating state. Does nothing before c is attached */
+void relinkVisibleClient(Client *c) {
+  Monitor *m = c->monitor;
+  int l = !ISVISIBLE(c)   ? VISIBLE_NONE
+          : c->isFloating ? VISIBLE_FLOATING
+                          : VISIBLE_TILED;
+
+  if (!c->prev && m->clients != c)
+    return;
+  if ((l == VISIBLE_NONE) != (c->visibleList == VISIBLE_NONE))
+    m->shownDirty = 1;
+  if (m->visibleDirty || l == c->visibleList)
+    return;
+  unlinkVisible(c);
+  if (l != VISIBLE_NONE)
+    linkVisible(c, l);
+}
 
-  // Append the new client
-  last->next = c;
+/* Must be called whenever the view of m changes, which may change the
+ * visibility of all its clients */
+void invalidateVisibleClients(Monitor *m) {
+  m->visibleDirty = 1;
+  m->shownDirty = 1;
+}
+
+Client *firstTiledClient(Monitor *m) {
+  if (m->visibleDirty)
+    rebuildVisibleClients(m);
+  return m->visible[VISIBLE_TILED];
+}
+
+Client *firstFloatingClient(Monitor *m) {
+  if (m->visibleDirty)
+    rebuildVisibleClients(m);
+  return m->visible[VISIBLE_FLOATING];
+}
+
+/* Walks all visible clients with nextVisibleClient(), tiled ones first */
+Client *firstVisibleClient(Monitor *m) {
+  Client *c = firstTiledClient(m);
+
+  return c ? c : m->visible[VISIBLE_FLOATING];
+}
+
+Client *nextVisibleClient(Client *c) {
+  if (c->nextVisible || c->visibleList != VISIBLE_TILED)
+    return c->nextVisible;
+  return c->monitor->visible[VISIBLE_FLOATING];
+}
+
+/* Both lists are doubly linked with a tail pointer, so attaching and
+ * detaching never walk them */
+void attach(Client *c) {
+  Monitor *m = c->monitor;
+
+  indexClient(c);
   c->next = NULL;
+  c->prev = m->lastClient;
+  if (m->lastClient)
+    m->lastClient->next = c;
+  else
+    m->clients = c;
+  m->lastClient = c;
+  c->visibleList = VISIBLE_NONE;
+  relinkVisibleClient(c);
+  /* a client from another monitor may have to be hidden */
+  m->shownDirty = 1;
+  invalidateLayout(m, c->workspaces);
+  verifyClientIndex();
 }
 
 void detach(Client *c) {
-  Client **tc;
+  Monitor *m = c->monitor;
 
-  for (tc = &c->monitor->clients; *tc && *tc != c; tc = &(*tc)->next)
-    ;
-  *tc = c->next;
+  removeDwindleClient(c);
+  unlinkVisible(c);
+  if (c->prev)
+    c->prev->next = c->next;
+  else
+    m->clients = c->next;
+  if (c->next)
+    c->next->prev = c->prev;
+  else
+    m->lastClient = c->prev;
+  c->next = c->prev = NULL;
+  invalidateLayout(m, c->workspaces);
+  unindexClient(c);
+  verifyClientIndex();
 }
 
 void attachWindowToStack(Client *c) {
-  c->nextInStack = c->monitor->stack;
-  c->monitor->stack = c;
+  Monitor *m = c->monitor;
+
+  c->prevInStack = NULL;
+  c->nextInStack = m->stack;
+  if (m->stack)
+    m->stack->prevInStack = c;
+  else
+    m->stackBottom = c;
+  m->stack = c;
 }
 
 void detachWindowFromStack(Client *c) {
-  Client **tc, *t;
+  Monitor *m = c->monitor;
+  Client *t;
 
-  for (tc = &c->monitor->stack; *tc && *tc != c; tc = &(*tc)->nextInStack)
-    ;
-  *tc = c->nextInStack;
+  if (c->prevInStack)
+    c->prevInStack->nextInStack = c->nextInStack;
+  else
+    m->stack = c->nextInStack;
+  if (c->nextInStack)
+    c->nextInStack->prevInStack = c->prevInStack;
+  else
+    m->stackBottom = c->prevInStack;
+  c->nextInStack = c->prevInStack = NULL;
 
-  if (c == c->monitor->active) {
-    for (t = c->monitor->stack; t && !ISVISIBLE(t); t = t->nextInStack)
+  if (c == m->active) {
+    for (t = m->stack; t && !ISVISIBLE(t); t = t->nextInStack)
       ;
-    c->monitor->active = t;
+    m->active = t;
   }
 }
 
 Client *findClientFromWindow(Window w) {
-  Client *c;
-  Monitor *m;
+  size_t i;
 
-  for (m = monitors; m; m = m->next)
-    for (c = m->clients; c; c = c->next)
-      if (c->win == w)
-        return c;
+  if (!indexCapacity)
+    return NULL;
+  for (i = indexSlot(w); clientIndex[i]; i = (i + 1) & (indexCapacity - 1))
+    if (clientIndex[i]->win == w)
+      return clientIndex[i];
   return NULL;
 }
 
-Client *getNextTiledWindow(Client *c) {
-  for (; c && (c->isFloating || !ISVISIBLE(c)); c = c->next)
-    ;
-  return c;
-}
-
 void updateClientList(void) {
   Client *c;
   Monitor *m;
+  Window *wins;
+  int n = 0;
+
+  for (m = monitors; m; m = m->next)
+    for (c = m->clients; c; c = c->next)
+      n++;
+  if (!n) {
+    XDeleteProperty(display, root, netAtoms[NET_CLIENT_LIST]);
+    return;
+  }
 
-  XDeleteProperty(display, root, netAtoms[NET_CLIENT_LIST]);
+  /* one request for the whole list instead of one append per client */
+  wins = ecalloc(n, sizeof(Window));
+  n = 0;
   for (m = monitors; m; m = m->next)
     for (c = m->clients; c; c = c->next)
-      XChangeProperty(display, root, netAtoms[NET_CLIENT_LIST], XA_WINDOW, 32,
-                      PropModeAppend, (unsigned char *)&(c->win), 1);
+      wins[n++] = c->win;
+  XChangeProperty(display, root, netAtoms[NET_CLIENT_LIST], XA_WINDOW, 32,
+                  PropModeReplace, (unsigned char *)wins, n);
+  free(wins);
 }
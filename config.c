@@ -13,6 +13,8 @@ Config cfg = {
     .borderWidth = 3,
     .borderInactiveColor = "#222222",
     .borderActiveColor = "#444444",
+    .borderUrgentColor = "",
+    .borderFloatingColor = "",
     .snapDistance = 0,
     .masterFactor = 0.5,
     .lockFullscreen = 1,
@@ -20,6 +22,7 @@ Config cfg = {
     .keybindings = NULL,
     .keybindingCapacity = 0,
     .moveCursorWithFocus = 1,
+    .hideMode = HIDE_MOVE,
     .logLevel = "info",
 };
 
@@ -88,6 +91,71 @@ KeySym parse_key(const char *key) {
   return XStringToKeysym(key);
 }
 
+static const struct {
+  const char *name;
+  int direction;
+} direction_map[] = {{"up", DIR_UP},
+                     {"down", DIR_DOWN},
+                     {"left", DIR_LEFT},
+                     {"right", DIR_RIGHT},
+                     {NULL, 0}};
+
+/* Turns kb->value into the argument its action takes, so a key press does no
+ * parsing. Workspaces must already be loaded. Returns 0 if value is invalid */
+static int compile_keybinding(Keybinding *kb) {
+  kb->arg = (Arg){0};
+
+  switch (kb->action) {
+  case ACTION_SPAWN:
+    if (!kb->value[0])
+      return 0;
+    kb->arg.v = parse_command_string(kb->value);
+    return kb->arg.v != NULL;
+
+  case ACTION_FOCUSMONITOR:
+  case ACTION_MOVETOMONITOR:
+    for (int i = 0; direction_map[i].name != NULL; i++) {
+      if (strcasecmp(kb->value, direction_map[i].name) == 0) {
+        kb->arg.i = direction_map[i].direction;
+        return 1;
+      }
+    }
+    return 0;
+
+  case ACTION_VIEWWORKSPACE:
+  case ACTION_MOVETOWORKSPACE:
+  case ACTION_DUPLICATETOWORKSPACE:
+  case ACTION_TOGGLEWORKSPACE:
+    // Convert workspace name to its mask
+    for (size_t i = 0; i < cfg.workspaceCount; i++) {
+      if (strcasecmp(kb->value, cfg.workspaces[i].name) == 0) {
+        kb->arg.ui = 1 << i;
+        return 1;
+      }
+    }
+    /* no workspace has always meant mask 0, which viewworkspace takes as
+     * "back to the previous view" */
+    if (kb->value[0])
+      LOG_WARN("Unknown workspace '%s', binding acts as if it had none",
+               kb->value);
+    return 1;
+
+  default:
+    return 1;
+  }
+}
+
+static void free_keybindings(void) {
+  for (size_t i = 0; i < cfg.keybindingCount; i++) {
+    Keybinding *kb = &cfg.keybindings[i];
+    if (kb->action == ACTION_SPAWN)
+      free_command_args((char **)kb->arg.v);
+    free(kb->value);
+    free(kb->description);
+  }
+  cfg.keybindingCount = 0;
+}
+
 void parse_keybinding(const char *key_str, toml_table_t *binding_table) {
   // Grow keybindings array if needed
   if (cfg.keybindingCount >= cfg.keybindingCapacity) {
@@ -151,6 +219,11 @@ void parse_keybinding(const char *key_str, toml_table_t *binding_table) {
     kb->description = strdup(""); // Empty string instead of NULL
   }
 
+  if (!compile_keybinding(kb)) {
+    LOG_ERROR("Invalid value for keybinding %s: '%s'", key_str, kb->value);
+    kb->action = ACTION_UNKNOWN;
+  }
+
   free(modifier_str);
   free(action.u.s);
   cfg.keybindingCount++;
@@ -165,7 +238,7 @@ void load_keybindings(toml_table_t *conf) {
     return;
   }
 
-  cfg.keybindingCount = 0;
+  free_keybindings();
 
   // Get number of entries in the keybindings table
   int keycount = toml_table_nkval(keybindings) + toml_table_ntab(keybindings);
@@ -321,59 +394,31 @@ static void load_workspaces(toml_table_t *conf) {
   }
 }
 
-// Add this to update_window_manager_state()
-void update_keybindings(void) {
-  // Clear existing keybindings
-  XUngrabKey(display, AnyKey, AnyModifier, root);
-
-  // Register new keybindings
-  updateNumlockMask();
-  unsigned int modifiers[] = {0, LockMask, numLockMask, numLockMask | LockMask};
-
-  for (int i = 0; i < cfg.keybindingCount; i++) {
-    KeyCode code = XKeysymToKeycode(display, cfg.keybindings[i].keysym);
-    if (code) {
-      for (size_t j = 0; j < LENGTH(modifiers); j++) {
-        XGrabKey(display, code, cfg.keybindings[i].modifier | modifiers[j],
-                 root, True, GrabModeAsync, GrabModeAsync);
-      }
-    }
-  }
-}
-
 void update_window_manager_state(void) {
   Monitor *m;
   Client *c;
 
+  loadBorderColors();
+
   // Update monitor properties
   for (m = monitors; m; m = m->next) {
     // Update all clients on this monitor
     for (c = m->clients; c; c = c->next) {
       if (!c->isFullscreen) { // Don't modify fullscreen windows
-        // Update border width
+        // Update border width, only sent to windows whose width changed
         c->borderWidth = cfg.borderWidth;
-        Clr activeBorderColor;
-        drw_clr_create(drawContext, &activeBorderColor, cfg.borderActiveColor);
-        Clr inactiveBorderColor;
-        drw_clr_create(drawContext, &inactiveBorderColor,
-                       cfg.borderInactiveColor);
-        XSetWindowBorder(display, c->win,
-                         (c == selectedMonitor->active)
-                             ? activeBorderColor.pixel
-                             : inactiveBorderColor.pixel);
-        // Apply border width change
-        XWindowChanges wc = {.x = c->x,
-                             .y = c->y,
-                             .width = c->w,
-                             .height = c->h,
-                             .border_width = c->borderWidth};
-        XConfigureWindow(display, c->win,
-                         CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
+        setClientBorder(c, c == selectedMonitor->active);
+        setWindowBorderWidth(c, c->borderWidth);
       }
+      // hide_mode may have changed
+      if (!c->isShown)
+        hideWindow(c);
     }
 
     // Update master factor and number of master windows
     m->masterFactor = cfg.masterFactor;
+    // Gaps and borders may have changed
+    invalidateLayout(m, ~0U);
   }
 
   setNumDesktops();
@@ -382,13 +427,10 @@ void update_window_manager_state(void) {
   setViewport();
 
   // Rearrange all monitors to apply gap changes and new layouts
-  arrange(NULL);
+  scheduleArrange(NULL);
 
   // Update keybindings
-  update_keybindings();
-
-  // Sync changes
-  XSync(display, False);
+  registerKeyboardShortcuts();
 }
 
 int load_config(const char *config_path) {
@@ -446,6 +488,20 @@ int load_config(const char *config_path) {
                   sizeof(cfg.borderInactiveColor));
       free(inactive.u.s);
     }
+
+    toml_datum_t urgent = toml_string_in(border, "urgent");
+    if (urgent.ok) {
+      safe_strcpy(cfg.borderUrgentColor, urgent.u.s,
+                  sizeof(cfg.borderUrgentColor));
+      free(urgent.u.s);
+    }
+
+    toml_datum_t floating = toml_string_in(border, "floating");
+    if (floating.ok) {
+      safe_strcpy(cfg.borderFloatingColor, floating.u.s,
+                  sizeof(cfg.borderFloatingColor));
+      free(floating.u.s);
+    }
   }
 
   // Layout configuration
@@ -470,6 +526,17 @@ int load_config(const char *config_path) {
     if (move_cursor_with_focus.ok) {
       cfg.moveCursorWithFocus = move_cursor_with_focus.u.b;
     }
+
+    toml_datum_t hide_mode = toml_string_in(windows, "hide_mode");
+    if (hide_mode.ok) {
+      if (strcmp(hide_mode.u.s, "move") == 0)
+        cfg.hideMode = HIDE_MOVE;
+      else if (strcmp(hide_mode.u.s, "unmap") == 0)
+        cfg.hideMode = HIDE_UNMAP;
+      else
+        LOG_WARN("Invalid hide mode: %s", hide_mode.u.s);
+      free(hide_mode.u.s);
+    }
   }
 
   toml_datum_t log_level = toml_string_in(conf, "log_level");
@@ -485,9 +552,10 @@ int load_config(const char *config_path) {
     }
   }
 
+  // Keybindings refer to workspaces by name, so those come first
+  load_workspaces(conf);
   load_keybindings(conf);
   load_startup_programs(conf);
-  load_workspaces(conf);
 
   toml_free(conf);
   return 1;
@@ -3,6 +3,12 @@
 
 #include "atlas.h"
 
+// How windows on hidden workspaces are hidden
+enum HideMode {
+  HIDE_MOVE, // Park them off screen, still mapped
+  HIDE_UNMAP // Unmap and iconify them, so they stop rendering
+};
+
 // Configuration structure
 typedef struct {
   // Gaps
@@ -12,6 +18,8 @@ typedef struct {
   unsigned int borderWidth;
   char borderActiveColor[8];
   char borderInactiveColor[8];
+  char borderUrgentColor[8];   // Empty to use the inactive color
+  char borderFloatingColor[8]; // Empty to use the inactive color
 
   // Layout
   int snapDistance;
@@ -21,6 +29,7 @@ typedef struct {
   // Window
   int focusNewWindows;
   int moveCursorWithFocus;
+  int hideMode;
 
   // Keybindings
   Keybinding *keybindings;
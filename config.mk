@@ -14,10 +14,13 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 -lXinerama ${FREETYPELIBS}
+LIBS = -L${X11LIB} -lX11 -lX11-xcb -lxcb -lXinerama ${FREETYPELIBS}
+
+# debug consistency checks, uncomment to enable
+#DEBUGFLAGS = -DATLASWM_DEBUG
 
 # flags
-CPPFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" -DXINERAMA -DCMAKE_EXPORT_COMPILE_COMMANDS=1
+CPPFLAGS = ${DEBUGFLAGS} -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_XOPEN_SOURCE=700L -DVERSION=\"${VERSION}\" -DXINERAMA -DCMAKE_EXPORT_COMPILE_COMMANDS=1
 CFLAGS   = -std=gnu17 -pedantic -Wall -Wno-deprecated-declarations -Wno-format-truncation -Wno-variadic-macros -Wno-gnu-zero-variadic-macro-arguments -O2 ${INCS} ${CPPFLAGS}
 LDFLAGS  = ${LIBS}
 
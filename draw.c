@@ -38,6 +38,14 @@ void drw_clr_create(DrawContext *drw, Clr *dest, const char *clrname) {
     die("error, cannot allocate color '%s'", clrname);
 }
 
+void drw_clr_free(DrawContext *drw, Clr *clr) {
+  if (!drw || !clr)
+    return;
+
+  XftColorFree(drw->dpy, DefaultVisual(drw->dpy, drw->screen),
+               DefaultColormap(drw->dpy, drw->screen), clr);
+}
+
 /* Create cursors */
 CursorWrapper *drw_cur_create(DrawContext *drw, int shape) {
   CursorWrapper *cur;
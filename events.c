@@ -4,6 +4,7 @@
 #include "atlas.h"
 #include "config.h"
 #include "ipc.h"
+#include "props.h"
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
 #include <stdlib.h>
@@ -78,30 +79,30 @@ void handleConfigureRequest(XEvent *e) {
                   ->arrange) {
       m = c->monitor;
       if (ev->value_mask & CWX) {
-        c->oldx = c->x;
+        c->cold->oldx = c->x;
         c->x = m->mx + ev->x;
       }
       if (ev->value_mask & CWY) {
-        c->oldy = c->y;
+        c->cold->oldy = c->y;
         c->y = m->my + ev->y;
       }
       if (ev->value_mask & CWWidth) {
-        c->oldw = c->w;
+        c->cold->oldw = c->w;
         c->w = ev->width;
       }
       if (ev->value_mask & CWHeight) {
-        c->oldh = c->h;
+        c->cold->oldh = c->h;
         c->h = ev->height;
       }
       if ((c->x + c->w) > m->mx + m->mw && c->isFloating)
         c->x = m->mx + (m->mw / 2 - WIDTH(c) / 2); /* center in x direction */
       if ((c->y + c->h) > m->my + m->mh && c->isFloating)
         c->y = m->my + (m->mh / 2 - HEIGHT(c) / 2); /* center in y direction */
-      if ((ev->value_mask & (CWX | CWY)) &&
-          !(ev->value_mask & (CWWidth | CWHeight)))
+      /* every request gets an answer: the server's ConfigureNotify if
+       * anything changed on screen, a synthetic one otherwise */
+      if (!(ISVISIBLE(c) &&
+            configureWindow(c, c->x, c->y, c->w, c->h, c->borderWidth)))
         configure(c);
-      if (ISVISIBLE(c))
-        XMoveResizeWindow(display, c->win, c->x, c->y, c->w, c->h);
     } else
       configure(c);
   } else {
@@ -114,7 +115,6 @@ void handleConfigureRequest(XEvent *e) {
     wc.stack_mode = ev->detail;
     XConfigureWindow(display, ev->window, ev->value_mask, &wc);
   }
-  XSync(display, False);
 }
 
 void handleWindowDestroy(XEvent *e) {
@@ -125,11 +125,18 @@ void handleWindowDestroy(XEvent *e) {
     unmanage(c, 1);
 }
 
+/* serial of the no-op restack() sends after restacking; crossings with a
+ * lower serial were generated while the server processed the restack and
+ * stem from it, later ones from the pointer moving */
+unsigned long enterIgnoreSerial = 0;
+
 void handleMouseEnter(XEvent *e) {
   Client *c;
   Monitor *m;
   XCrossingEvent *ev = &e->xcrossing;
 
+  if (ev->serial < enterIgnoreSerial)
+    return;
   if ((ev->mode != NotifyNormal || ev->detail == NotifyInferior) &&
       ev->window != root)
     return;
@@ -186,19 +193,21 @@ void handlePropertyChange(XEvent *e) {
         XFree(data);
       }
     }
-  } else if (ev->state == PropertyDelete)
-    return; /* ignore */
-  else if ((c = findClientFromWindow(ev->window))) {
+  } else if ((c = findClientFromWindow(ev->window))) {
+    /* a deleted property leaves the cached copy just as stale */
+    invalidateWindowProps(c, ev->atom);
+    if (ev->state == PropertyDelete)
+      return;
     switch (ev->atom) {
     default:
       break;
     case XA_WM_TRANSIENT_FOR:
       if (!c->isFloating && (XGetTransientForHint(display, c->win, &trans)) &&
-          (c->isFloating = (findClientFromWindow(trans)) != NULL))
-        arrange(c->monitor);
-      break;
-    case XA_WM_NORMAL_HINTS:
-      c->hintsvalid = 0;
+          (c->isFloating = (findClientFromWindow(trans)) != NULL)) {
+        relinkVisibleClient(c);
+        invalidateLayout(c->monitor, c->workspaces);
+        scheduleArrange(c->monitor);
+      }
       break;
     case XA_WM_HINTS:
       updateWindowManagerHints(c);
@@ -216,8 +225,20 @@ void handleWindowUnmap(XEvent *e) {
   Client *c;
   XUnmapEvent *ev = &e->xunmap;
 
+  /* a real unmap of a client is reported to the root, which selects
+   * SubstructureNotify, and to the client window itself; only the latter
+   * counts, so each unmap is handled once. Synthetic withdrawals are sent to
+   * the root */
+  if (!ev->send_event && ev->event != ev->window)
+    return;
   if ((c = findClientFromWindow(ev->window))) {
-    if (ev->send_event)
+    if (!ev->send_event && c->ignoreUnmap) {
+      c->ignoreUnmap--; /* hideWindow() unmapped it */
+      return;
+    }
+    /* a window hidden by unmapping gets no real unmap when it withdraws,
+     * so the synthetic one has to let it go */
+    if (ev->send_event && !c->isHidden)
       setclientstate(c, WithdrawnState);
     else
       unmanage(c, 0);
@@ -226,34 +247,38 @@ void handleWindowUnmap(XEvent *e) {
 
 void handleKeymappingChange(XEvent *e) {
   XMappingEvent *ev = &e->xmapping;
+  Monitor *m;
+  Client *c;
 
   XRefreshKeyboardMapping(ev);
-  if (ev->request == MappingKeyboard)
-    registerKeyboardShortcuts();
+  if (ev->request == MappingPointer)
+    return;
+  if (updateNumlockMask())
+    for (m = monitors; m; m = m->next)
+      for (c = m->clients; c; c = c->next)
+        registerMouseButtons(c, c == selectedMonitor->active);
+  registerKeyboardShortcuts();
 }
 
 void handleWindowMappingRequest(XEvent *e) {
-  static XWindowAttributes wa;
+  WindowQuery q;
+  WindowInfo info;
   XMapRequestEvent *ev = &e->xmaprequest;
 
-  if (!XGetWindowAttributes(display, ev->window, &wa) || wa.override_redirect)
+  if (findClientFromWindow(ev->window))
+    return;
+  queryWindow(ev->window, &q);
+  if (!collectWindowInfo(&q, &info) || info.overrideRedirect)
     return;
-  if (!findClientFromWindow(ev->window))
-    manage(ev->window, &wa);
+  manage(ev->window, &info);
 }
 
 void handleKeypress(XEvent *e) {
   XKeyEvent *ev = &e->xkey;
-  KeySym keysym = XKeycodeToKeysym(display, (KeyCode)ev->keycode, 0);
-  unsigned int cleanMask = CLEANMASK(ev->state);
+  Keybinding *kb;
 
-  for (int i = 0; i < cfg.keybindingCount; i++) {
-    if (cfg.keybindings[i].keysym == keysym &&
-        CLEANMASK(cfg.keybindings[i].modifier) == cleanMask) {
-      executeKeybinding(&cfg.keybindings[i]);
-      return;
-    }
-  }
+  if ((kb = findKeybinding((KeyCode)ev->keycode, ev->state)))
+    executeKeybinding(kb);
 }
 
 void handleWindowConfigChange(XEvent *e) {
@@ -291,6 +316,6 @@ void handleWindowConfigChange(XEvent *e) {
   }
 
   // Reset focus and rearrange all windows
-  focus(NULL);
-  arrange(NULL);
+  scheduleFocus(NULL, 0);
+  scheduleArrange(NULL);
 }
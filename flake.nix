@@ -31,6 +31,7 @@
             pkg-config
             gcc
             xorg.libX11
+            xorg.libxcb
             xorg.libXinerama
             xorg.xorgproto
             xorg.libXft
@@ -54,6 +55,7 @@
           gcc
           pkg-config
           xorg.libX11
+          xorg.libxcb
           xorg.xorgproto
           xorg.libXinerama
           xorg.libXft
@@ -16,9 +16,7 @@ void focus(Client *c) {
     detachWindowFromStack(c);
     attachWindowToStack(c);
     registerMouseButtons(c, 1);
-    Clr borderColor;
-    drw_clr_create(drawContext, &borderColor, cfg.borderActiveColor);
-    XSetWindowBorder(display, c->win, borderColor.pixel);
+    setClientBorder(c, 1);
     setfocus(c);
   } else {
     XSetInputFocus(display, root, RevertToPointerRoot, CurrentTime);
@@ -31,15 +29,53 @@ void unfocus(Client *c, int setfocus) {
   if (!c)
     return;
   registerMouseButtons(c, 0);
-  Clr borderColor;
-  drw_clr_create(drawContext, &borderColor, cfg.borderInactiveColor);
-  XSetWindowBorder(display, c->win, borderColor.pixel);
+  setClientBorder(c, 0);
   if (setfocus) {
     XSetInputFocus(display, root, RevertToPointerRoot, CurrentTime);
     XDeleteProperty(display, root, netAtoms[NET_ACTIVE_WINDOW]);
   }
 }
 
+/* Resolves the configured border colors to pixels, so focus changes only
+ * have to send XSetWindowBorder */
+void loadBorderColors(void) {
+  static int loaded = 0;
+  const char *names[BORDER_COUNT] = {
+      [BORDER_ACTIVE] = cfg.borderActiveColor,
+      [BORDER_INACTIVE] = cfg.borderInactiveColor,
+      [BORDER_URGENT] = cfg.borderUrgentColor,
+      [BORDER_FLOATING] = cfg.borderFloatingColor,
+  };
+  int i;
+
+  if (loaded)
+    freeBorderColors();
+  for (i = 0; i < BORDER_COUNT; i++)
+    /* unset state colors fall back to the inactive one */
+    drw_clr_create(drawContext, &borderColors[i],
+                   names[i][0] ? names[i] : cfg.borderInactiveColor);
+  loaded = 1;
+}
+
+void freeBorderColors(void) {
+  int i;
+
+  for (i = 0; i < BORDER_COUNT; i++)
+    drw_clr_free(drawContext, &borderColors[i]);
+}
+
+void setClientBorder(Client *c, int active) {
+  int color = BORDER_INACTIVE;
+
+  if (active)
+    color = BORDER_ACTIVE;
+  else if (c->isUrgent)
+    color = BORDER_URGENT;
+  else if (c->isFloating)
+    color = BORDER_FLOATING;
+  setWindowBorderPixel(c, borderColors[color].pixel);
+}
+
 void focusMonitor(const Arg *arg) {
     Monitor *m;
 
@@ -53,13 +89,7 @@ void focusMonitor(const Arg *arg) {
     selectedMonitor = m;
 
     // Check if there are any visible clients on the monitor
-    Client *c = NULL;
-    for (Client *t = m->clients; t; t = t->next) {
-        if (ISVISIBLE(t)) {
-            c = t;
-            break;
-        }
-    }
+    Client *c = firstVisibleClient(m);
 
     if (c) {
         // Found a visible client, focus it and move cursor to its center
@@ -79,21 +109,21 @@ void focusMonitor(const Arg *arg) {
     }
 }
 
+/* Cycles in client order, which the split visible lists do not keep, so it
+ * walks the client list */
 void focusstack(const Arg *arg) {
-  Client *c = NULL, *i;
+  Client *c = NULL, *i, *active = selectedMonitor->active;
 
-  if (!selectedMonitor->active ||
-      (selectedMonitor->active->isFullscreen && cfg.lockFullscreen))
+  if (!active || (active->isFullscreen && cfg.lockFullscreen))
     return;
   if (arg->i > 0) {
-    for (c = selectedMonitor->active->next; c && !ISVISIBLE(c); c = c->next)
+    for (c = active->next; c && !ISVISIBLE(c); c = c->next)
       ;
     if (!c)
       for (c = selectedMonitor->clients; c && !ISVISIBLE(c); c = c->next)
         ;
   } else {
-    for (i = selectedMonitor->clients; i != selectedMonitor->active;
-         i = i->next)
+    for (i = selectedMonitor->clients; i != active; i = i->next)
       if (ISVISIBLE(i))
         c = i;
     if (!c)
@@ -3,6 +3,8 @@
 #include "util.h"
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
+#include <stdlib.h>
+#include <string.h>
 
 /* HACK: Need to implement TOML config for these */
 #define MODKEY Mod4Mask
@@ -13,62 +15,130 @@ static const Button buttons[] = {
     {CLICK_CLIENT_WINDOW, MODKEY, Button3, resizeWindow, {0}},
 };
 
-void registerMouseButtons(Client *c, int focused) {
-  updateNumlockMask();
-  {
-    unsigned int i, j;
-    unsigned int modifiers[] = {0, LockMask, numLockMask,
-                                numLockMask | LockMask};
-    XUngrabButton(display, AnyButton, AnyModifier, c->win);
-    if (!focused)
-      XGrabButton(display, AnyButton, AnyModifier, c->win, False, BUTTONMASK,
-                  GrabModeSync, GrabModeSync, None, None);
-    for (i = 0; i < LENGTH(buttons); i++)
-      if (buttons[i].click == CLICK_CLIENT_WINDOW)
-        for (j = 0; j < LENGTH(modifiers); j++)
-          XGrabButton(display, buttons[i].button,
-                      buttons[i].mask | modifiers[j], c->win, False, BUTTONMASK,
-                      GrabModeAsync, GrabModeSync, None, None);
+/* Keybindings by keycode and cleaned modifier mask, open addressing with
+ * linear probing. Rebuilt with the key grabs, since keycodes and the numlock
+ * mask only change then */
+typedef struct {
+  unsigned int key; // keycode << 16 | CLEANMASK(modifier), 0 if empty
+  size_t binding;   // index into cfg.keybindings
+} KeySlot;
+
+static KeySlot *keyTable = NULL;
+static size_t keyTableCapacity = 0;
+static unsigned int keyTableBits = 0; // log2 of keyTableCapacity
+
+static unsigned int keySlotKey(KeyCode code, unsigned int mask) {
+  return (unsigned int)code << 16 | CLEANMASK(mask);
+}
+
+/* Fibonacci hashing, taking the top bits of the 64-bit product */
+static size_t keySlot(unsigned int key) {
+  return (size_t)((key * 11400714819323198485ull) >> (64 - keyTableBits));
+}
+
+static void buildKeyTable(KeyCode *codes) {
+  size_t i, j, capacity = 16;
+  unsigned int key, bits = 4;
+
+  /* keep the load factor at or below one half */
+  while (capacity < cfg.keybindingCount * 2)
+    capacity *= 2, bits++;
+  keyTableBits = bits;
+  if (capacity != keyTableCapacity) {
+    free(keyTable);
+    keyTable = ecalloc(capacity, sizeof(KeySlot));
+    keyTableCapacity = capacity;
+  } else
+    memset(keyTable, 0, capacity * sizeof(KeySlot));
+
+  for (i = 0; i < cfg.keybindingCount; i++) {
+    if (!codes[i])
+      continue;
+    key = keySlotKey(codes[i], cfg.keybindings[i].modifier);
+    for (j = keySlot(key); keyTable[j].key && keyTable[j].key != key;
+         j = (j + 1) & (keyTableCapacity - 1))
+      ;
+    /* the first binding for a combination wins */
+    if (!keyTable[j].key) {
+      keyTable[j].key = key;
+      keyTable[j].binding = i;
+    }
   }
 }
 
+Keybinding *findKeybinding(KeyCode code, unsigned int state) {
+  unsigned int key = keySlotKey(code, state);
+  size_t i;
+
+  if (!keyTableCapacity)
+    return NULL;
+  for (i = keySlot(key); keyTable[i].key; i = (i + 1) & (keyTableCapacity - 1))
+    if (keyTable[i].key == key)
+      return keyTable[i].binding < cfg.keybindingCount
+                 ? &cfg.keybindings[keyTable[i].binding]
+                 : NULL;
+  return NULL;
+}
+
+void registerMouseButtons(Client *c, int focused) {
+  unsigned int i, j;
+
+  if (!buttonGrabsChanged(c, focused))
+    return;
+  XUngrabButton(display, AnyButton, AnyModifier, c->win);
+  if (!focused)
+    XGrabButton(display, AnyButton, AnyModifier, c->win, False, BUTTONMASK,
+                GrabModeSync, GrabModeSync, None, None);
+  for (i = 0; i < LENGTH(buttons); i++)
+    if (buttons[i].click == CLICK_CLIENT_WINDOW)
+      for (j = 0; j < LENGTH(lockModifiers); j++)
+        XGrabButton(display, buttons[i].button,
+                    buttons[i].mask | lockModifiers[j], c->win, False,
+                    BUTTONMASK, GrabModeAsync, GrabModeSync, None, None);
+}
+
 void registerKeyboardShortcuts(void) {
+  KeyCode *codes = ecalloc(cfg.keybindingCount + 1, sizeof(KeyCode));
+
   // Clear any existing key bindings
   XUngrabKey(display, AnyKey, AnyModifier, root);
 
-  // Get numlock mask
-  updateNumlockMask();
-
-  // Common modifier combinations to handle
-  unsigned int modifiers[] = {0, LockMask, numLockMask, numLockMask | LockMask};
-
   // Register all configured keybindings from TOML config
-  for (int i = 0; i < cfg.keybindingCount; i++) {
-    KeyCode code = XKeysymToKeycode(display, cfg.keybindings[i].keysym);
-    if (code) {
+  for (size_t i = 0; i < cfg.keybindingCount; i++) {
+    codes[i] = XKeysymToKeycode(display, cfg.keybindings[i].keysym);
+    if (codes[i]) {
       // Register the keybinding with all modifier combinations
-      for (size_t j = 0; j < LENGTH(modifiers); j++) {
-        XGrabKey(display, code, cfg.keybindings[i].modifier | modifiers[j],
-                 root, True, GrabModeAsync, GrabModeAsync);
+      for (size_t j = 0; j < LENGTH(lockModifiers); j++) {
+        XGrabKey(display, codes[i],
+                 cfg.keybindings[i].modifier | lockModifiers[j], root, True,
+                 GrabModeAsync, GrabModeAsync);
       }
     } else {
-      LOG_ERROR("Failed to get keycode for keysym in binding %d", i);
+      LOG_ERROR("Failed to get keycode for keysym in binding %zu", i);
     }
   }
+  buildKeyTable(codes);
+  free(codes);
 }
 
-void updateNumlockMask(void) {
-  unsigned int i, j;
+/* Only called at startup and on MappingNotify, grabs use the cached
+ * lockModifiers in between. Returns whether the numlock mask changed */
+int updateNumlockMask(void) {
+  unsigned int i, j, old = numLockMask;
   XModifierKeymap *modmap;
+  KeyCode numlock = XKeysymToKeycode(display, XK_Num_Lock);
 
   numLockMask = 0;
   modmap = XGetModifierMapping(display);
   for (i = 0; i < 8; i++)
     for (j = 0; j < modmap->max_keypermod; j++)
-      if (modmap->modifiermap[i * modmap->max_keypermod + j] ==
-          XKeysymToKeycode(display, XK_Num_Lock))
+      if (numlock &&
+          modmap->modifiermap[i * modmap->max_keypermod + j] == numlock)
         numLockMask = (1 << i);
   XFreeModifiermap(modmap);
+  lockModifiers[2] = numLockMask;
+  lockModifiers[3] = numLockMask | LockMask;
+  return numLockMask != old;
 }
 
 void moveWindow(const Arg *arg) {
@@ -98,6 +168,7 @@ void moveWindow(const Arg *arg) {
     case Expose:
     case MapRequest:
       eventHandlers[ev.type](&ev);
+      commitScheduled();
       break;
     case MotionNotify:
       nx = ocx + (ev.xmotion.x - x);
@@ -127,7 +198,6 @@ void moveWindow(const Arg *arg) {
   if ((m = getMonitorForArea(c->x, c->y, c->w, c->h)) != selectedMonitor) {
     sendWindowToMonitor(c, m);
     selectedMonitor = m;
-    focus(NULL);
   }
 }
 
@@ -179,10 +249,11 @@ void resizeWindow(const Arg *arg) {
     case Expose:
     case MapRequest:
       eventHandlers[ev.type](&ev);
+      commitScheduled();
       break;
     case MotionNotify:
-      nx = hCorner && ocx2 - ev.xmotion.x >= c->minw ? ev.xmotion.x : c->x;
-      ny = vCorner && ocy2 - ev.xmotion.y >= c->minh ? ev.xmotion.y : c->y;
+      nx = hCorner && ocx2 - ev.xmotion.x >= c->cold->minw ? ev.xmotion.x : c->x;
+      ny = vCorner && ocy2 - ev.xmotion.y >= c->cold->minh ? ev.xmotion.y : c->y;
       nw = MAX(hCorner ? (ocx2 - nx)
                        : (ev.xmotion.x - ocx - 2 * c->borderWidth + 1),
                1);
@@ -191,15 +262,17 @@ void resizeWindow(const Arg *arg) {
                1);
 
       if (hCorner && ev.xmotion.x > ocx2)
-        nx = ocx2 - (nw = c->minw);
+        nx = ocx2 - (nw = c->cold->minw);
       if (vCorner && ev.xmotion.y > ocy2)
-        ny = ocy2 - (nh = c->minh);
+        ny = ocy2 - (nh = c->cold->minh);
 
       if (isDwindle) {
         if (c->isFloating) {
           resize(c, nx, ny, nw, nh, 1);
         } else {
-          // TODO: Implement dwindle layout
+          resizeDwindleSplit(c, hCorner ? ev.xmotion.x : ev.xmotion.x + 1,
+                             vCorner ? ev.xmotion.y : ev.xmotion.y + 1,
+                             hCorner, vCorner);
         }
       } else {
         // Original floating window resize behavior
@@ -229,7 +302,6 @@ void resizeWindow(const Arg *arg) {
   if ((m = getMonitorForArea(c->x, c->y, c->w, c->h)) != selectedMonitor) {
     sendWindowToMonitor(c, m);
     selectedMonitor = m;
-    focus(NULL);
   }
 }
 
@@ -56,6 +56,9 @@ void handle_command(CommandType cmd) {
     LOG_INFO("Received reload command");
     reload_config();
     break;
+  case CMD_STATS:
+    logEventStats();
+    break;
   default:
     LOG_ERROR("Unknown command received: %d", cmd);
   }
@@ -4,7 +4,7 @@
 #include <X11/Xlib.h>
 
 // Command types
-typedef enum { CMD_RELOAD = 1 } CommandType;
+typedef enum { CMD_RELOAD = 1, CMD_STATS = 2 } CommandType;
 
 extern Atom command_atom;
 
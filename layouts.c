@@ -3,26 +3,123 @@
 #include "util.h"
 #include <X11/Xlib.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
 
-void arrange(Monitor *m) {
-  if (m)
-    toggleWindowVisibility(m->stack);
-  else
-    for (m = monitors; m; m = m->next)
-      toggleWindowVisibility(m->stack);
-  if (m) {
-    arrangeMonitor(m);
-    restack(m);
-  } else
-    for (m = monitors; m; m = m->next)
-      arrangeMonitor(m);
+/* Index of the lowest workspace in the view, which keys the per-workspace
+ * layout state of views spanning several, or -1 for an empty view */
+static int viewIndex(Monitor *m) {
+  unsigned int view = m->workspaceset[m->selectedWorkspaces];
+
+  return view && ffs(view) <= MAX_WORKSPACES ? ffs(view) - 1 : -1;
+}
+
+/* Configures the clients whose slot differs from their current geometry;
+ * resize() leaves the others alone, so they get no request and no
+ * synthetic ConfigureNotify */
+static void applySlots(LayoutSlot *slots, unsigned int n) {
+  LayoutSlot *s;
+  Client *c;
+
+  for (s = slots; s < slots + n; s++) {
+    c = s->client;
+    if (s->x == c->x && s->y == c->y && s->w == WIDTH(c) &&
+        s->h == HEIGHT(c))
+      continue;
+    resize(c, s->x, s->y, s->w - 2 * c->borderWidth,
+           s->h - 2 * c->borderWidth, 0);
+  }
+}
+
+/* The tiled window monocle shows: restack keeps tiled windows in stack
+ * order, so it is the first visible one there */
+static Client *monocleTop(Monitor *m) {
+  Client *c;
+
+  for (c = m->stack; c && (c->isFloating || !ISVISIBLE(c)); c = c->nextInStack)
+    ;
+  return c;
 }
 
+/* Layouts only compute: they fill m->slots through placeClient(), and
+ * applyLayout() turns the result into requests. The result is kept per
+ * workspace, so coming back to one whose clients, floating states, ratios,
+ * window area and, for monocle, top window did not change skips the layout */
 void arrangeMonitor(Monitor *m) {
-  safe_strcpy(m->layoutSymbol, m->layouts[m->selectedLayout]->symbol,
-              sizeof m->layoutSymbol);
-  if (m->layouts[m->selectedLayout]->arrange)
-    m->layouts[m->selectedLayout]->arrange(m);
+  const Layout *layout = m->layouts[m->selectedLayout];
+  unsigned int view = m->workspaceset[m->selectedWorkspaces];
+  LayoutCache *lc = NULL;
+  LayoutSlot *slots;
+  unsigned int capacity;
+  int i = viewIndex(m);
+
+  if (i >= 0)
+    lc = &m->layoutCache[i];
+  if (lc && layout->arrange && m->layoutValid & 1U << i && lc->view == view &&
+      lc->layout == layout && lc->wx == m->wx && lc->wy == m->wy &&
+      lc->ww == m->ww && lc->wh == m->wh &&
+      (layout->arrange != monocle || lc->top == monocleTop(m))) {
+    safe_strcpy(m->layoutSymbol, lc->layoutSymbol, sizeof m->layoutSymbol);
+    /* clients shown on several workspaces may sit elsewhere */
+    applySlots(lc->slots, lc->slotCount);
+    eventStats.layoutsReused++;
+    return;
+  }
+  safe_strcpy(m->layoutSymbol, layout->symbol, sizeof m->layoutSymbol);
+  m->slotCount = 0;
+  if (!layout->arrange)
+    return;
+  layout->arrange(m);
+  applyLayout(m);
+  if (!lc)
+    return;
+  /* the entry keeps the slots and hands its old array over as scratch */
+  slots = lc->slots;
+  capacity = lc->slotCapacity;
+  lc->slots = m->slots;
+  lc->slotCapacity = m->slotCapacity;
+  lc->slotCount = m->slotCount;
+  m->slots = slots;
+  m->slotCapacity = capacity;
+  m->slotCount = 0;
+  lc->view = view;
+  lc->layout = layout;
+  lc->wx = m->wx, lc->wy = m->wy, lc->ww = m->ww, lc->wh = m->wh;
+  lc->top = layout->arrange == monocle ? monocleTop(m) : NULL;
+  safe_strcpy(lc->layoutSymbol, m->layoutSymbol, sizeof lc->layoutSymbol);
+  m->layoutValid |= 1U << i;
+}
+
+/* Drops the cached layouts of m whose view includes one of workspaces;
+ * called when clients come or go, change workspaces or floating state, or
+ * splits and gaps change */
+void invalidateLayout(Monitor *m, unsigned int workspaces) {
+  unsigned int v;
+
+  for (v = m->layoutValid; v; v &= v - 1)
+    if (m->layoutCache[ffs(v) - 1].view & workspaces)
+      m->layoutValid &= ~(v & -v);
+}
+
+/* Records where the layout wants c; the rectangle includes the border */
+void placeClient(Monitor *m, Client *c, int x, int y, int w, int h) {
+  LayoutSlot *slots;
+  unsigned int capacity;
+
+  if (m->slotCount >= m->slotCapacity) {
+    capacity = m->slotCapacity ? m->slotCapacity * 2 : 16;
+    if (!(slots = realloc(m->slots, capacity * sizeof *slots))) {
+      LOG_ERROR("Failed to allocate memory for layout slots");
+      return;
+    }
+    m->slots = slots;
+    m->slotCapacity = capacity;
+  }
+  m->slots[m->slotCount++] = (LayoutSlot){c, x, y, w, h};
+}
+
+void applyLayout(Monitor *m) {
+  applySlots(m->slots, m->slotCount);
 }
 
 void setlayout(const Arg *arg) {
@@ -36,7 +133,7 @@ void setlayout(const Arg *arg) {
               selectedMonitor->layouts[selectedMonitor->selectedLayout]->symbol,
               sizeof selectedMonitor->layoutSymbol);
   if (selectedMonitor->active)
-    arrange(selectedMonitor);
+    scheduleArrange(selectedMonitor);
 }
 
 /* arg > 1.0 will set mfact absolutely */
@@ -50,109 +147,376 @@ void setMasterRatio(const Arg *arg) {
   if (f < 0.05 || f > 0.95)
     return;
   selectedMonitor->masterFactor = f;
-  arrange(selectedMonitor);
+  invalidateLayout(selectedMonitor, ~0U);
+  scheduleArrange(selectedMonitor);
 }
 
+/* Only the top window is configured; the others keep whatever geometry they
+ * had, hidden under it, and are fitted by restack when they get raised. A
+ * window that would stick out of the work area is fitted right away */
 void monocle(Monitor *m) {
   unsigned int n = 0;
-  Client *c;
+  Client *c, *top = monocleTop(m);
 
-  for (c = m->clients; c; c = c->next)
-    if (ISVISIBLE(c))
-      n++;
+  for (c = firstVisibleClient(m); c; c = nextVisibleClient(c))
+    n++;
   if (n > 0) /* override layout symbol */
     snprintf(m->layoutSymbol, sizeof m->layoutSymbol, "[%d]", n);
-  for (c = getNextTiledWindow(m->clients); c; c = getNextTiledWindow(c->next))
-    resize(c, m->wx, m->wy, m->ww - 2 * c->borderWidth,
-           m->wh - 2 * c->borderWidth, 0);
+  for (c = firstTiledClient(m); c; c = c->nextVisible)
+    if (c == top || c->x < m->wx || c->y < m->wy ||
+        c->x + WIDTH(c) > m->wx + m->ww || c->y + HEIGHT(c) > m->wy + m->wh)
+      placeClient(m, c, m->wx, m->wy, m->ww, m->wh);
 }
 
-void dwindlegaps(Monitor *m) {
-  Client *c;
-  unsigned int n = 0;
+static DwindleNode *findDwindleLeaf(DwindleNode *n, Client *c) {
+  DwindleNode *leaf;
 
-  // Count visible clients
-  for (c = getNextTiledWindow(m->clients); c; c = getNextTiledWindow(c->next))
-    n++;
+  if (!n || !n->first)
+    return n && n->client == c ? n : NULL;
+  if ((leaf = findDwindleLeaf(n->first, c)))
+    return leaf;
+  return findDwindleLeaf(n->second, c);
+}
 
-  if (n == 0)
-    return;
+/* Makes the next layout recompute n and every split above it */
+static void markDwindleDirty(DwindleNode *n) {
+  for (; n; n = n->parent)
+    n->dirty = 1;
+}
 
-  // Calculate available space considering outer gaps
-  int x = m->wx + cfg.outerGaps;
-  int y = m->wy + cfg.outerGaps;
-  int w = m->ww - (2 * cfg.outerGaps);
-  int h = m->wh - (2 * cfg.outerGaps);
+/* Splits the deepest leaf of the spiral, across the way its parent split,
+ * so the tree grows in the order clients are attached */
+static void insertDwindleClient(DwindleNode **root, Client *c) {
+  DwindleNode *leaf, *split, *t;
 
-  // Single window case
-  if (n == 1) {
-    c = getNextTiledWindow(m->clients);
-    resize(c, x, y, w - (2 * c->borderWidth), h - (2 * c->borderWidth), 0);
+  leaf = ecalloc(1, sizeof(DwindleNode));
+  leaf->client = c;
+  leaf->dirty = 1;
+  if (!(t = *root)) {
+    *root = leaf;
     return;
   }
+  while (t->first)
+    t = t->second;
+  split = ecalloc(1, sizeof(DwindleNode));
+  split->vertical = t->parent ? !t->parent->vertical : 1;
+  split->ratio = 0.5;
+  split->parent = t->parent;
+  if (t->parent)
+    t->parent->second = split;
+  else
+    *root = split;
+  split->first = t;
+  split->second = leaf;
+  t->parent = leaf->parent = split;
+  markDwindleDirty(split);
+}
 
-  c = getNextTiledWindow(m->clients);
-  int i = 0;
-  int remaining_w = w;
-  int remaining_h = h;
-  int current_x = x;
-  int current_y = y;
+/* The sibling of leaf takes the place and the area of their parent split */
+static void removeDwindleLeaf(DwindleNode **root, DwindleNode *leaf) {
+  DwindleNode *split = leaf->parent, *sibling;
 
-  while (c) {
-    Client *next = getNextTiledWindow(c->next);
+  if (!split)
+    *root = NULL;
+  else {
+    sibling = split->first == leaf ? split->second : split->first;
+    sibling->parent = split->parent;
+    if (!split->parent)
+      *root = sibling;
+    else if (split->parent->first == split)
+      split->parent->first = sibling;
+    else
+      split->parent->second = sibling;
+    markDwindleDirty(sibling);
+    free(split);
+  }
+  free(leaf);
+}
 
-    // Initialize ratios if not set
-    if (c->horizontalRatio <= 0)
-      c->horizontalRatio = 0.5;
-    if (c->verticalRatio <= 0)
-      c->verticalRatio = 0.5;
+/* Drops c from every split tree of its monitor, before it leaves it */
+void removeDwindleClient(Client *c) {
+  Monitor *m = c->monitor;
+  DwindleNode *leaf;
+  int i;
 
-    if (!next) {
-      // Last window uses remaining space
-      resize(c, current_x, current_y, remaining_w - (2 * c->borderWidth),
-             remaining_h - (2 * c->borderWidth), 0);
-      break;
+  for (i = 0; c->dwindleTrees; i++)
+    if (c->dwindleTrees & 1U << i) {
+      if ((leaf = findDwindleLeaf(m->dwindle[i], c)))
+        removeDwindleLeaf(&m->dwindle[i], leaf);
+      c->dwindleTrees &= ~(1U << i);
     }
+}
 
-    if (i % 2 == 0) {
-      // Vertical split using horizontalRatio
-      int new_w = (remaining_w - cfg.innerGaps) * c->horizontalRatio;
-      resize(c, current_x, current_y, new_w - (2 * c->borderWidth),
-             remaining_h - (2 * c->borderWidth), 0);
-      current_x += new_w + cfg.innerGaps;
-      remaining_w = remaining_w - new_w - cfg.innerGaps;
-    } else {
-      // Horizontal split using verticalRatio
-      int new_h = (remaining_h - cfg.innerGaps) * c->verticalRatio;
-      resize(c, current_x, current_y, remaining_w - (2 * c->borderWidth),
-             new_h - (2 * c->borderWidth), 0);
-      current_y += new_h + cfg.innerGaps;
-      remaining_h = remaining_h - new_h - cfg.innerGaps;
+/* Leaf of a client that left the tree's workspace, if any */
+static DwindleNode *findStaleLeaf(DwindleNode *n, unsigned int bit) {
+  DwindleNode *leaf;
+
+  if (!n->first)
+    return n->client->workspaces & bit ? NULL : n;
+  if ((leaf = findStaleLeaf(n->first, bit)))
+    return leaf;
+  return findStaleLeaf(n->second, bit);
+}
+
+/* Counts the clients under n this tree places: tiled ones whose lowest
+ * workspace in the view is the tree's. Nodes whose count changed, or that
+ * hold such a node, are marked dirty */
+static int countTiled(DwindleNode *n, unsigned int bit, unsigned int view) {
+  unsigned int shared;
+  int tiled;
+
+  if (!n->first) {
+    shared = n->client->workspaces & view;
+    tiled = !n->client->isFloating && (shared & -shared) == bit;
+  } else {
+    tiled = countTiled(n->first, bit, view) + countTiled(n->second, bit, view);
+    if (n->first->dirty || n->second->dirty)
+      n->dirty = 1;
+  }
+  if (tiled != n->tiled)
+    n->dirty = 1;
+  return n->tiled = tiled;
+}
+
+/* Places the tiled clients under n where the last layout put them */
+static void placeDwindleLeaves(Monitor *m, DwindleNode *n) {
+  if (!n->first)
+    placeClient(m, n->client, n->x, n->y, n->w, n->h);
+  else {
+    if (n->first->tiled)
+      placeDwindleLeaves(m, n->first);
+    if (n->second->tiled)
+      placeDwindleLeaves(m, n->second);
+  }
+}
+
+/* Places the tiled clients under n in the given area. Floating clients keep
+ * their leaf, so they return to the same spot, but get no area. Only dirty
+ * nodes and nodes whose area moved are split again; the others reuse the
+ * areas of the last layout */
+static void layoutDwindleNode(Monitor *m, DwindleNode *n, int x, int y, int w,
+                              int h) {
+  int size;
+
+  if (!n->dirty && n->gaps == cfg.innerGaps && n->x == x && n->y == y &&
+      n->w == w && n->h == h) {
+    placeDwindleLeaves(m, n);
+    return;
+  }
+  n->dirty = 0;
+  n->gaps = cfg.innerGaps;
+  n->x = x, n->y = y, n->w = w, n->h = h;
+  if (!n->first) {
+    if (n->tiled)
+      placeClient(m, n->client, x, y, w, h);
+  } else if (!n->second->tiled)
+    layoutDwindleNode(m, n->first, x, y, w, h);
+  else if (!n->first->tiled)
+    layoutDwindleNode(m, n->second, x, y, w, h);
+  else if (n->vertical) {
+    size = (w - cfg.innerGaps) * n->ratio;
+    layoutDwindleNode(m, n->first, x, y, size, h);
+    layoutDwindleNode(m, n->second, x + size + cfg.innerGaps, y,
+                      w - size - cfg.innerGaps, h);
+  } else {
+    size = (h - cfg.innerGaps) * n->ratio;
+    layoutDwindleNode(m, n->first, x, y, w, size);
+    layoutDwindleNode(m, n->second, x, y + size + cfg.innerGaps, w,
+                      h - size - cfg.innerGaps);
+  }
+}
+
+/* Keeps a split tree per workspace instead of rebuilding the spiral: clients
+ * that left a workspace lose their leaf in its tree, new tiled ones split
+ * the deepest leaf of each viewed tree they are on, and every split keeps
+ * its ratio. A view spanning several workspaces shows their trees side by
+ * side, a client shown on several of them in the lowest one's tree */
+void dwindlegaps(Monitor *m) {
+  unsigned int view = m->workspaceset[m->selectedWorkspaces], v, bit, add;
+  DwindleNode *leaf;
+  int i, n = 0, x, w;
+  Client *c;
+
+  for (v = view; v; v &= v - 1) {
+    i = ffs(v) - 1;
+    while (m->dwindle[i] && (leaf = findStaleLeaf(m->dwindle[i], 1U << i))) {
+      leaf->client->dwindleTrees &= ~(1U << i);
+      removeDwindleLeaf(&m->dwindle[i], leaf);
     }
+  }
+  for (c = firstTiledClient(m); c; c = c->nextVisible)
+    for (add = c->workspaces & view & ~c->dwindleTrees; add; add &= add - 1) {
+      bit = add & -add;
+      insertDwindleClient(&m->dwindle[ffs(bit) - 1], c);
+      c->dwindleTrees |= bit;
+    }
+  for (v = view; v; v &= v - 1) {
+    i = ffs(v) - 1;
+    if (m->dwindle[i] && countTiled(m->dwindle[i], 1U << i, view))
+      n++;
+  }
+  if (!n)
+    return;
+  x = m->wx + cfg.outerGaps;
+  w = (m->ww - 2 * cfg.outerGaps - (n - 1) * cfg.innerGaps) / n;
+  for (v = view; v; v &= v - 1) {
+    i = ffs(v) - 1;
+    if (!m->dwindle[i] || !m->dwindle[i]->tiled)
+      continue;
+    /* the last tree takes what rounding left over */
+    if (!--n)
+      w = m->wx + m->ww - cfg.outerGaps - x;
+    layoutDwindleNode(m, m->dwindle[i], x, m->wy + cfg.outerGaps, w,
+                      m->wh - 2 * cfg.outerGaps);
+    x += w + cfg.innerGaps;
+  }
+}
+
+/* Moves the splits that the dragged edges of c lie on to the root
+ * coordinates x, y, the edges' outer side, and reconfigures only the clients
+ * under them */
+void resizeDwindleSplit(Client *c, int x, int y, int hCorner, int vCorner) {
+  Monitor *m = c->monitor;
+  unsigned int shared = c->workspaces & m->workspaceset[m->selectedWorkspaces];
+  DwindleNode *n, *child, *hSplit = NULL, *vSplit = NULL, *outer = NULL;
 
-    c = next;
-    i++;
+  /* c is laid out by the tree of the lowest workspace it shares with the
+   * view */
+  if (!shared || !(n = findDwindleLeaf(m->dwindle[ffs(shared) - 1], c)))
+    return;
+  /* the nearest split in each direction with c on the dragged side, skipping
+   * splits that have nothing tiled on the other side */
+  for (child = n, n = n->parent; n; child = n, n = n->parent) {
+    if (!n->first->tiled || !n->second->tiled ||
+        (child == n->second) != (n->vertical ? hCorner : vCorner))
+      continue;
+    if (n->vertical && !hSplit)
+      hSplit = outer = n;
+    else if (!n->vertical && !vSplit)
+      vSplit = outer = n;
   }
+  if (!hSplit && !vSplit)
+    return;
+  /* a dragged left or top edge is past the gap after the first child */
+  if (hSplit && hSplit->w > cfg.innerGaps)
+    hSplit->ratio = MAX(0.05, MIN(0.95, (float)(x - hSplit->x -
+                                                hCorner * cfg.innerGaps) /
+                                            (hSplit->w - cfg.innerGaps)));
+  if (vSplit && vSplit->h > cfg.innerGaps)
+    vSplit->ratio = MAX(0.05, MIN(0.95, (float)(y - vSplit->y -
+                                                vCorner * cfg.innerGaps) /
+                                            (vSplit->h - cfg.innerGaps)));
+  markDwindleDirty(hSplit);
+  markDwindleDirty(vSplit);
+  invalidateLayout(m, shared & -shared);
+  /* both splits are above c, so the outer one holds the other */
+  m->slotCount = 0;
+  layoutDwindleNode(m, outer, outer->x, outer->y, outer->w, outer->h);
+  applyLayout(m);
+}
+
+/* Brings the server order of m's tiled windows to the stack order. The
+ * shadow holds the order they were last restacked in, so only the span from
+ * just above the first window out of place down to the last one is sent, and
+ * nothing when the order is unchanged. Windows that left the list need no
+ * request; they are hidden or gone */
+static int restackTiled(Monitor *m) {
+  Window *order;
+  unsigned int n = 0, first = 0, last = 0, capacity;
+  int moved = 0;
+  Client *c;
+
+  for (c = m->stack; c; c = c->nextInStack) {
+    if (c->isFloating || !ISVISIBLE(c))
+      continue;
+    if (n >= m->stackCapacity) {
+      capacity = m->stackCapacity ? m->stackCapacity * 2 : 16;
+      if (!(order = realloc(m->stackOrder, capacity * sizeof *order))) {
+        LOG_ERROR("Failed to allocate memory for the stacking order");
+        m->stackCount = 0;
+        return 0;
+      }
+      m->stackOrder = order;
+      m->stackCapacity = capacity;
+    }
+    if (n >= m->stackCount || m->stackOrder[n] != c->win) {
+      if (!moved)
+        first = n;
+      last = n;
+      moved = 1;
+    }
+    m->stackOrder[n++] = c->win;
+  }
+  m->stackCount = n;
+  if (!moved)
+    return 0;
+  /* the first window of the span stays put and the rest go under it; with a
+   * new top window nothing below it is known to be in place */
+  if (first)
+    first--;
+  else
+    last = n - 1;
+  if (last == first)
+    return 0;
+  XRestackWindows(display, m->stackOrder + first, last - first + 1);
+  return 1;
 }
 
 void restack(Monitor *m) {
   Client *c;
-  XEvent ev;
-  XWindowChanges wc;
+  int sent = 0;
 
+  /* focus changes in monocle raise a window that may not be fitted yet;
+   * resize() skips it if it already is */
+  if (m->layouts[m->selectedLayout]->arrange == monocle && (c = monocleTop(m)))
+    resize(c, m->wx, m->wy, m->ww - 2 * c->borderWidth,
+           m->wh - 2 * c->borderWidth, 0);
+  updateOcclusion(m);
   if (!m->active)
     return;
-  if (m->active->isFloating || !m->layouts[m->selectedLayout]->arrange)
+  if (m->active->isFloating || !m->layouts[m->selectedLayout]->arrange) {
     XRaiseWindow(display, m->active->win);
-  if (m->layouts[m->selectedLayout]->arrange) {
-    wc.stack_mode = Below;
-    for (c = m->stack; c; c = c->nextInStack)
-      if (!c->isFloating && ISVISIBLE(c)) {
-        XConfigureWindow(display, c->win, CWSibling | CWStackMode, &wc);
-        wc.sibling = c->win;
-      }
+    sent = 1;
+  }
+  if (m->layouts[m->selectedLayout]->arrange)
+    sent |= restackTiled(m);
+  /* rather than waiting for the crossings our restacking causes and draining
+   * them, mark the end of the restack with a no-op: crossings the server
+   * generated before reaching it carry a lower serial, and handleMouseEnter
+   * drops those. Pointer crossings after it keep theirs */
+  if (sent) {
+    enterIgnoreSerial = NextRequest(display);
+    XNoOp(display);
   }
-  XSync(display, False);
-  while (XCheckMaskEvent(display, EnterWindowMask, &ev))
+}
+
+/* Marks visible windows that are fully covered with _NET_WM_STATE_HIDDEN so
+ * their applications can stop rendering: everything under the topmost
+ * visible fullscreen window, whether or not it has focus, and in monocle
+ * every tiled window but the top one. Floating windows focused after the
+ * fullscreen one were raised above it and stay uncovered. Only windows whose
+ * state changed get a request */
+void updateOcclusion(Monitor *m) {
+  Client *c, *top = NULL, *fullscreen;
+  int occluded, below = 0;
+
+  for (fullscreen = m->stack;
+       fullscreen && !(fullscreen->isFullscreen && ISVISIBLE(fullscreen));
+       fullscreen = fullscreen->nextInStack)
     ;
+  if (!fullscreen && m->layouts[m->selectedLayout]->arrange == monocle)
+    top = monocleTop(m);
+  for (c = m->stack; c; c = c->nextInStack) {
+    if (!ISVISIBLE(c))
+      continue;
+    if (fullscreen)
+      occluded = below || (c != fullscreen && !c->isFloating);
+    else
+      occluded = top && c != top && !c->isFloating;
+    below |= c == fullscreen;
+    if (occluded != c->isOccluded) {
+      c->isOccluded = occluded;
+      updateNetWMState(c);
+    }
+  }
 }
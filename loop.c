@@ -0,0 +1,445 @@
+// LOOP
+// "When should the window manager wake up?"
+
+#include "atlas.h"
+#include "config.h"
+#include "util.h"
+#include <X11/Xlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define MAX_LOOP_SOURCES 16
+#define MAX_LOOP_EVENTS 16
+#define EVENT_BATCH_MAX 256
+
+typedef struct {
+  int fd;                // Watched file descriptor, -1 if the slot is free
+  int isTimer;           // Whether fd is a timerfd that must be drained
+  LoopCallback callback; // Called when fd becomes readable
+  void *data;            // Passed back to the callback
+} LoopSource;
+
+static int epollFd = -1;
+static int signalFd = -1;
+static LoopSource sources[MAX_LOOP_SOURCES];
+static XEvent batch[EVENT_BATCH_MAX];
+static unsigned char superseded[EVENT_BATCH_MAX];
+
+/* work deferred to the end of the current event batch */
+static int focusPending = 0;
+static Client *pendingFocus = NULL;
+static Client *pendingWarp = NULL;
+static int clientListPending = 0;
+static int switchPending = 0;
+static unsigned long switchStartSerial = 0;
+
+static int (*previousAfterFunction)(Display *) = NULL;
+static unsigned long lastRoundTripSerial = 0;
+
+EventStats eventStats;
+
+static int addSource(int fd, int isTimer, LoopCallback cb, void *data) {
+  struct epoll_event ev = {0};
+  int i;
+
+  for (i = 0; i < MAX_LOOP_SOURCES && sources[i].fd != -1; i++)
+    ;
+  if (i == MAX_LOOP_SOURCES) {
+    LOG_ERROR("Too many event loop sources, ignoring fd %d", fd);
+    return -1;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = i;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    LOG_ERROR("Failed to watch fd %d: %s", fd, strerror(errno));
+    return -1;
+  }
+  sources[i].fd = fd;
+  sources[i].isTimer = isTimer;
+  sources[i].callback = cb;
+  sources[i].data = data;
+  return 0;
+}
+
+static void handleSignal(int fd, void *data) {
+  struct signalfd_siginfo si;
+
+  while (read(fd, &si, sizeof si) == sizeof si) {
+    switch (si.ssi_signo) {
+    case SIGHUP:
+      LOG_INFO("Received SIGHUP, reloading configuration");
+      reload_config();
+      break;
+    default:
+      LOG_INFO("Received signal %u, exiting", si.ssi_signo);
+      isWMRunning = 0;
+      break;
+    }
+  }
+}
+
+/* The one place round-trips are counted, for Xlib and XCB waits alike. A
+ * wait is keyed by the request it waited for, so seeing the same wait from
+ * both sides counts it once */
+void noteRoundTrip(unsigned long serial) {
+  if (serial == lastRoundTripSerial)
+    return;
+  lastRoundTripSerial = serial;
+  eventStats.roundTrips++;
+}
+
+/* Xlib calls this after every request function. Having seen the reply to
+ * our latest request means the call waited for the server. */
+static int afterRequest(Display *dpy) {
+  unsigned long processed = LastKnownRequestProcessed(dpy);
+
+  if (processed == NextRequest(dpy) - 1)
+    noteRoundTrip(processed);
+  return previousAfterFunction ? previousAfterFunction(dpy) : 0;
+}
+
+void setupEventLoop(void) {
+  sigset_t mask;
+
+  for (int i = 0; i < MAX_LOOP_SOURCES; i++)
+    sources[i].fd = -1;
+
+  previousAfterFunction = XSetAfterFunction(display, afterRequest);
+
+  if ((epollFd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    LOG_FATAL("Failed to create epoll instance: %s", strerror(errno));
+
+  /* the X connection is drained by runEventLoop itself */
+  if (addSource(ConnectionNumber(display), 0, NULL, NULL) == -1)
+    LOG_FATAL("Failed to watch the X connection");
+
+  /* deliver termination and reload requests through the loop, children get
+   * their signal mask reset before exec */
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  sigaddset(&mask, SIGHUP);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1 ||
+      (signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+    LOG_WARN("Failed to set up signalfd: %s", strerror(errno));
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+    return;
+  }
+  addSource(signalFd, 0, handleSignal, NULL);
+}
+
+void cleanupEventLoop(void) {
+  for (int i = 0; i < MAX_LOOP_SOURCES; i++)
+    if (sources[i].fd != -1 && sources[i].isTimer)
+      close(sources[i].fd);
+  if (signalFd != -1)
+    close(signalFd);
+  if (epollFd != -1)
+    close(epollFd);
+  signalFd = epollFd = -1;
+}
+
+int watchLoopFd(int fd, LoopCallback cb, void *data) {
+  return addSource(fd, 0, cb, data);
+}
+
+void unwatchLoopFd(int fd) {
+  for (int i = 0; i < MAX_LOOP_SOURCES; i++)
+    if (sources[i].fd == fd) {
+      epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+      sources[i].fd = -1;
+      return;
+    }
+}
+
+int createLoopTimer(LoopCallback cb, void *data) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (fd == -1) {
+    LOG_ERROR("Failed to create timer: %s", strerror(errno));
+    return -1;
+  }
+  if (addSource(fd, 1, cb, data) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* one-shot, a delay of 0 disarms the timer */
+void armLoopTimer(int fd, unsigned int ms) {
+  struct itimerspec its = {0};
+
+  its.it_value.tv_sec = ms / 1000;
+  its.it_value.tv_nsec = (long)(ms % 1000) * 1000000L;
+  if (timerfd_settime(fd, 0, &its, NULL) == -1)
+    LOG_ERROR("Failed to arm timer %d: %s", fd, strerror(errno));
+}
+
+void destroyLoopTimer(int fd) {
+  unwatchLoopFd(fd);
+  close(fd);
+}
+
+/* events after which the window's identity or mapping may have changed, nothing
+ * is merged across them */
+static int isBarrier(XEvent *ev, Window w) {
+  switch (ev->type) {
+  case DestroyNotify:
+    return ev->xdestroywindow.window == w;
+  case UnmapNotify:
+    return ev->xunmap.window == w;
+  case MapRequest:
+    return ev->xmaprequest.window == w;
+  case ReparentNotify:
+    return ev->xreparent.window == w;
+  }
+  return 0;
+}
+
+/* fold the fields an older request set but a newer one did not into the newer */
+static void mergeConfigureRequest(XConfigureRequestEvent *old,
+                                  XConfigureRequestEvent *new) {
+  unsigned long missing = old->value_mask & ~new->value_mask;
+
+  if (missing & CWX)
+    new->x = old->x;
+  if (missing & CWY)
+    new->y = old->y;
+  if (missing & CWWidth)
+    new->width = old->width;
+  if (missing & CWHeight)
+    new->height = old->height;
+  if (missing & CWBorderWidth)
+    new->border_width = old->border_width;
+  if (missing & CWSibling)
+    new->above = old->above;
+  if (missing & CWStackMode)
+    new->detail = old->detail;
+  new->value_mask |= old->value_mask;
+}
+
+static int supersedes(XEvent *later, XEvent *ev) {
+  if (later->type != ev->type)
+    return 0;
+  switch (ev->type) {
+  case MotionNotify:
+    return later->xmotion.window == ev->xmotion.window;
+  case PropertyNotify:
+    return later->xproperty.window == ev->xproperty.window &&
+           later->xproperty.atom == ev->xproperty.atom &&
+           later->xproperty.state == ev->xproperty.state;
+  case ConfigureRequest:
+    return later->xconfigurerequest.window == ev->xconfigurerequest.window;
+  }
+  return 0;
+}
+
+static Window coalescedWindow(XEvent *ev) {
+  switch (ev->type) {
+  case MotionNotify:
+    return ev->xmotion.window;
+  case PropertyNotify:
+    return ev->xproperty.window;
+  case ConfigureRequest:
+    return ev->xconfigurerequest.window;
+  }
+  return None;
+}
+
+/* mark events a later event in the batch makes redundant */
+static unsigned int coalesceBatch(int n) {
+  unsigned int collapsed = 0;
+  Window w;
+  int i, j;
+
+  for (i = 0; i < n; i++) {
+    superseded[i] = 0;
+    if (!(w = coalescedWindow(&batch[i])))
+      continue;
+    for (j = i + 1; j < n && !isBarrier(&batch[j], w); j++)
+      if (supersedes(&batch[j], &batch[i])) {
+        if (batch[i].type == ConfigureRequest)
+          mergeConfigureRequest(&batch[i].xconfigurerequest,
+                                &batch[j].xconfigurerequest);
+        superseded[i] = 1;
+        collapsed++;
+        break;
+      }
+  }
+  return collapsed;
+}
+
+/* drain what Xlib has queued or can read without blocking, collapse redundant
+ * events and dispatch the survivors */
+static void dispatchEvent(XEvent *ev) {
+  unsigned long roundTrips = eventStats.roundTrips;
+
+  eventStats.eventsByType[ev->type]++;
+  eventHandlers[ev->type](ev); /* call handler */
+  if ((roundTrips = eventStats.roundTrips - roundTrips)) {
+    eventStats.roundTripsByType[ev->type] += roundTrips;
+    eventStats.maxRoundTrips = MAX(eventStats.maxRoundTrips, roundTrips);
+    LOG_DEBUG("Event type %d took %lu round-trips", ev->type, roundTrips);
+  }
+}
+
+static int dispatchEventBatch(void) {
+  unsigned long roundTrips;
+  unsigned int collapsed;
+  int i, n = 0;
+
+  while (n < EVENT_BATCH_MAX && XPending(display)) {
+    XNextEvent(display, &batch[n]);
+    /* moveWindow and resizeWindow read the events following a button press
+     * straight from the queue, so leave those there */
+    if (batch[n++].type == ButtonPress)
+      break;
+  }
+  if (n == 0)
+    return 0;
+
+  collapsed = coalesceBatch(n);
+  eventStats.batches++;
+  eventStats.events += n;
+  eventStats.collapsed += collapsed;
+  if (collapsed)
+    LOG_DEBUG("Event batch of %d collapsed %u redundant events", n, collapsed);
+
+  for (i = 0; i < n && isWMRunning; i++)
+    if (!superseded[i] && eventHandlers[batch[i].type])
+      dispatchEvent(&batch[i]);
+  roundTrips = eventStats.roundTrips;
+  commitScheduled();
+  eventStats.commitRoundTrips += eventStats.roundTrips - roundTrips;
+  /* everything the batch produced goes out in one write */
+  XFlush(display);
+  return n;
+}
+
+/* NULL marks every monitor */
+void scheduleArrange(Monitor *m) {
+  if (m)
+    m->needsArrange = 1;
+  else
+    for (m = monitors; m; m = m->next)
+      m->needsArrange = 1;
+}
+
+/* the last request in a batch wins, like it would have with eager focus() */
+void scheduleFocus(Client *c, int warp) {
+  focusPending = 1;
+  pendingFocus = c;
+  pendingWarp = warp ? c : NULL;
+}
+
+void scheduleClientListUpdate(void) { clientListPending = 1; }
+
+/* Counts the requests from here to the end of the next commit against a
+ * workspace switch */
+void noteWorkspaceSwitch(void) {
+  if (!switchPending)
+    switchStartSerial = NextRequest(display);
+  switchPending = 1;
+}
+
+/* drop references to a client that is about to be freed */
+void forgetScheduled(Client *c) {
+  if (pendingFocus == c)
+    pendingFocus = NULL;
+  if (pendingWarp == c)
+    pendingWarp = NULL;
+}
+
+void commitScheduled(void) {
+  Monitor *m;
+
+  /* arrange in two halves around focus: newly shown windows must be mapped
+   * before they can take the input focus, and restacking wants the new
+   * active client */
+  for (m = monitors; m; m = m->next)
+    if (m->needsArrange)
+      updateWindowVisibility(m);
+  if (focusPending) {
+    focusPending = 0;
+    focus(pendingFocus);
+  }
+  for (m = monitors; m; m = m->next)
+    if (m->needsArrange) {
+      m->needsArrange = 0;
+      arrangeMonitor(m);
+      restack(m);
+    }
+  /* warping needs the geometry arrange just computed */
+  if (pendingWarp) {
+    moveCursorToClientCenter(pendingWarp);
+    pendingWarp = NULL;
+  }
+  if (clientListPending) {
+    clientListPending = 0;
+    updateClientList();
+  }
+  if (switchPending) {
+    switchPending = 0;
+    eventStats.workspaceSwitches++;
+    eventStats.switchRequests += NextRequest(display) - switchStartSerial;
+  }
+  verifyWindowShadows();
+}
+
+void logEventStats(void) {
+  LOG_INFO("Events: %lu in %lu batches, %lu collapsed", eventStats.events,
+           eventStats.batches, eventStats.collapsed);
+  LOG_INFO("Round-trips: %lu total, %lu at most per event, %lu in commits",
+           eventStats.roundTrips, eventStats.maxRoundTrips,
+           eventStats.commitRoundTrips);
+  if (eventStats.workspaceSwitches)
+    LOG_INFO("Workspace switches: %lu, %.1f requests each",
+             eventStats.workspaceSwitches,
+             (double)eventStats.switchRequests / eventStats.workspaceSwitches);
+  if (eventStats.suppressedRequests)
+    LOG_INFO("Requests suppressed by the shadow: %lu",
+             eventStats.suppressedRequests);
+  if (eventStats.layoutsReused)
+    LOG_INFO("Layouts reused from cache: %lu", eventStats.layoutsReused);
+  for (int i = 0; i < LASTEvent; i++)
+    if (eventStats.roundTripsByType[i])
+      LOG_INFO("Round-trips for event type %d: %lu (%lu events)", i,
+               eventStats.roundTripsByType[i], eventStats.eventsByType[i]);
+}
+
+void runEventLoop(void) {
+  struct epoll_event events[MAX_LOOP_EVENTS];
+  uint64_t expirations;
+  int i, n;
+
+  while (isWMRunning) {
+    if (dispatchEventBatch())
+      continue;
+    /* XPending flushed our requests, so it is safe to sleep until any source
+     * has something for us; no timeout means no idle wakeups */
+    n = epoll_wait(epollFd, events, MAX_LOOP_EVENTS, -1);
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      LOG_FATAL("epoll_wait failed: %s", strerror(errno));
+    }
+    for (i = 0; i < n; i++) {
+      LoopSource *s = &sources[events[i].data.u32];
+      if (s->fd == -1 || !s->callback)
+        continue;
+      if (s->isTimer &&
+          read(s->fd, &expirations, sizeof expirations) != sizeof expirations)
+        continue;
+      s->callback(s->fd, s->data);
+    }
+    commitScheduled();
+  }
+}
@@ -26,6 +26,7 @@ Monitor *createMonitor(void) {
   Monitor *m;
 
   m = ecalloc(1, sizeof(Monitor));
+  m->layoutCache = ecalloc(MAX_WORKSPACES, sizeof(LayoutCache));
   m->workspaceset[0] = m->workspaceset[1] = 1;
   m->masterFactor = cfg.masterFactor;
   m->layouts[0] = &layouts[0];
@@ -36,6 +37,7 @@ Monitor *createMonitor(void) {
 
 void cleanupMonitor(Monitor *mon) {
   Monitor *m;
+  int i;
 
   if (mon == monitors)
     monitors = monitors->next;
@@ -44,6 +46,11 @@ void cleanupMonitor(Monitor *mon) {
       ;
     m->next = mon->next;
   }
+  free(mon->slots);
+  free(mon->stackOrder);
+  for (i = 0; i < MAX_WORKSPACES; i++)
+    free(mon->layoutCache[i].slots);
+  free(mon->layoutCache);
   free(mon);
 }
 
@@ -92,7 +99,7 @@ int updateMonitorGeometry(void) {
         ;
       while ((c = m->clients)) {
         dirty = 1;
-        m->clients = c->next;
+        detach(c);
         detachWindowFromStack(c);
         c->monitor = monitors;
         attach(c);
@@ -197,6 +204,7 @@ Monitor *getMonitorForArea(int x, int y, int w, int h) {
 void sendWindowToMonitor(Client *c, Monitor *m) {
   if (c->monitor == m)
     return;
+  scheduleArrange(c->monitor);
   unfocus(c, 1);
   detach(c);
   detachWindowFromStack(c);
@@ -206,6 +214,6 @@ void sendWindowToMonitor(Client *c, Monitor *m) {
                                                  monitor */
   attach(c);
   attachWindowToStack(c);
-  focus(NULL);
-  arrange(NULL);
+  scheduleFocus(NULL, 0);
+  scheduleArrange(m);
 }
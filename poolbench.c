@@ -0,0 +1,155 @@
+// POOLBENCH
+// "Does the client pool make list walks cheaper?"
+
+/* Standalone benchmark behind `make bench`, not part of atlaswm. It builds
+ * the same client list twice, once with every client in its own ecalloc'd
+ * record as before the pool, once from slabs laid out like the ones in
+ * client.c, and times a walk reading what layouts read. Other allocations
+ * are mixed in between clients, like property replies are while managing */
+
+#include "atlas.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SLAB_SIZE 64 /* CLIENT_SLAB_SIZE */
+#define ROUNDS 200
+#define FLUSH_SIZE (64 << 20)
+#define NOISE_SLOTS (1 << 16)
+
+/* Both halves in one record, title first, the way Client used to be */
+typedef struct OldClient OldClient;
+struct OldClient {
+  ClientCold cold;
+  Client hot;
+  OldClient *next;
+};
+
+typedef struct Slab Slab;
+struct Slab {
+  Client hot[SLAB_SIZE];
+  ClientCold cold[SLAB_SIZE];
+  Slab *next;
+};
+
+static Client *freeClients;
+static Slab *slabs;
+static char *noise[NOISE_SLOTS];
+static unsigned int noiseCount;
+static char *flushBuffer;
+
+static Client *allocPooled(void) {
+  Client *c;
+  Slab *s;
+  int i;
+
+  if (!freeClients) {
+    if (!(s = calloc(1, sizeof *s)))
+      exit(1);
+    s->next = slabs;
+    slabs = s;
+    for (i = SLAB_SIZE - 1; i >= 0; i--) {
+      s->hot[i].cold = &s->cold[i];
+      s->hot[i].next = freeClients;
+      freeClients = &s->hot[i];
+    }
+  }
+  c = freeClients;
+  freeClients = c->next;
+  return c;
+}
+
+static void allocNoise(void) {
+  unsigned int k;
+
+  noise[noiseCount++ % NOISE_SLOTS] = malloc(40 + rand() % 600);
+  if (rand() % 2) {
+    k = rand() % noiseCount % NOISE_SLOTS;
+    free(noise[k]);
+    noise[k] = NULL;
+  }
+}
+
+static double now(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static void flushCache(void) {
+  int i;
+
+  for (i = 0; i < FLUSH_SIZE; i += 64)
+    flushBuffer[i]++;
+}
+
+static void run(int n) {
+  OldClient *oldClients = NULL, **oldTail = &oldClients, *o;
+  Client *clients = NULL, **tail = &clients, *c;
+  double oldCold = 0, newCold = 0, oldWarm = 0, newWarm = 0, t;
+  volatile long sink = 0;
+  int i, r;
+
+  for (i = 0; i < n; i++) {
+    allocNoise();
+    if (!(o = calloc(1, sizeof *o)))
+      exit(1);
+    o->hot.workspaces = 1U << i % 9;
+    o->hot.isFloating = i % 7 == 0;
+    o->hot.x = i;
+    *oldTail = o;
+    oldTail = &o->next;
+  }
+  for (i = 0; i < n; i++) {
+    allocNoise();
+    c = allocPooled();
+    c->workspaces = 1U << i % 9;
+    c->isFloating = i % 7 == 0;
+    c->x = i;
+    *tail = c;
+    tail = &c->next;
+  }
+
+  for (r = 0; r < ROUNDS; r++) {
+    flushCache();
+    t = now();
+    for (o = oldClients; o; o = o->next)
+      if (o->hot.workspaces & 1 && !o->hot.isFloating)
+        sink += o->hot.x + o->hot.w;
+    oldCold += now() - t;
+    flushCache();
+    t = now();
+    for (c = clients; c; c = c->next)
+      if (c->workspaces & 1 && !c->isFloating)
+        sink += c->x + c->w;
+    newCold += now() - t;
+    t = now();
+    for (o = oldClients; o; o = o->next)
+      if (o->hot.workspaces & 1 && !o->hot.isFloating)
+        sink += o->hot.x + o->hot.w;
+    oldWarm += now() - t;
+    t = now();
+    for (c = clients; c; c = c->next)
+      if (c->workspaces & 1 && !c->isFloating)
+        sink += c->x + c->w;
+    newWarm += now() - t;
+  }
+  printf("%5d clients  walk %6.1f ns %6.1f ns  warm %6.2f ns %6.2f ns\n", n,
+         oldCold / ROUNDS / n, newCold / ROUNDS / n, oldWarm / ROUNDS / n,
+         newWarm / ROUNDS / n);
+}
+
+int main(void) {
+  if (!(flushBuffer = malloc(FLUSH_SIZE)))
+    return 1;
+  memset(flushBuffer, 1, FLUSH_SIZE);
+  printf("client %zu bytes, hot %zu, cold %zu, slab of %d %zu\n",
+         sizeof(OldClient), sizeof(Client), sizeof(ClientCold), SLAB_SIZE,
+         sizeof(Slab));
+  printf("columns: ecalloc'd records, then pooled; walk times per client\n");
+  run(1000);
+  run(5000);
+  return 0;
+}
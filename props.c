@@ -0,0 +1,375 @@
+// PROPS
+// "What does this window say about itself?"
+
+#include "props.h"
+#include "atlas.h"
+#include "util.h"
+#include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
+#include <X11/Xutil.h>
+#include <xcb/xcbext.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* element counts of the ICCCM property layouts, see Xlib's Xatomtype.h */
+#define SIZE_HINTS_ELEMENTS 18
+#define OLD_SIZE_HINTS_ELEMENTS 15
+#define WM_HINTS_ELEMENTS 9
+
+/* Cached properties and the query that fetches each */
+static const struct {
+  unsigned int bit;
+  int query;
+} cachedProps[] = {
+    {PROP_PROTOCOLS, QUERY_PROTOCOLS},    {PROP_HINTS, QUERY_HINTS},
+    {PROP_NORMAL_HINTS, QUERY_NORMAL_HINTS}, {PROP_CLASS, QUERY_CLASS},
+    {PROP_WINDOW_TYPE, QUERY_WINDOW_TYPE}, {PROP_STATE, QUERY_NET_WM_STATE},
+};
+
+static xcb_get_property_cookie_t requestProperty(xcb_connection_t *conn,
+                                                 Window w, int p) {
+  Atom prop, type;
+  uint32_t len = 1;
+
+  switch (p) {
+  case QUERY_TRANSIENT_FOR:
+    prop = XA_WM_TRANSIENT_FOR, type = XA_WINDOW;
+    break;
+  case QUERY_CLASS:
+    prop = XA_WM_CLASS, type = XA_STRING, len = 512;
+    break;
+  case QUERY_NET_WM_STATE:
+    prop = netAtoms[NET_WM_STATE], type = XA_ATOM, len = MAX_NET_STATES;
+    break;
+  case QUERY_WINDOW_TYPE:
+    prop = netAtoms[NET_WM_WINDOW_TYPE], type = XA_ATOM;
+    break;
+  case QUERY_NORMAL_HINTS:
+    prop = XA_WM_NORMAL_HINTS, type = XA_WM_SIZE_HINTS;
+    len = SIZE_HINTS_ELEMENTS;
+    break;
+  case QUERY_HINTS:
+    prop = XA_WM_HINTS, type = XA_WM_HINTS, len = WM_HINTS_ELEMENTS;
+    break;
+  case QUERY_PROTOCOLS:
+    prop = wmAtoms[WM_PROTOCOLS], type = XA_ATOM, len = 64;
+    break;
+  case QUERY_WM_STATE:
+    prop = type = wmAtoms[WM_STATE], len = 2;
+    break;
+  case QUERY_NET_WM_NAME:
+    prop = netAtoms[NET_WM_NAME], type = AnyPropertyType;
+    len = sizeof ((WindowInfo *)0)->name / 4;
+    break;
+  default: /* QUERY_WM_NAME */
+    prop = XA_WM_NAME, type = AnyPropertyType;
+    len = sizeof ((WindowInfo *)0)->name / 4;
+    break;
+  }
+  return xcb_get_property(conn, 0, w, prop, type, 0, len);
+}
+
+/* Sends every request manage() needs without waiting for any reply */
+void queryWindow(Window w, WindowQuery *q) {
+  xcb_connection_t *conn = XGetXCBConnection(display);
+  int p;
+
+  q->attributes = xcb_get_window_attributes(conn, w);
+  q->geometry = xcb_get_geometry(conn, w);
+  for (p = 0; p < QUERY_PROP_COUNT; p++)
+    q->props[p] = requestProperty(conn, w, p);
+}
+
+/* Replies that are not in yet mean waiting on the server */
+static void *awaitReply(xcb_connection_t *conn, unsigned int sequence) {
+  unsigned long last = NextRequest(display) - 1;
+  void *reply = NULL;
+
+  if (xcb_poll_for_reply(conn, sequence, &reply, NULL))
+    return reply;
+  /* XCB sequences are the low 32 bits of Xlib's serials, and Xlib's count
+   * may lag behind requests sent through XCB */
+  noteRoundTrip(last + (long)(int)(sequence - (unsigned int)last));
+  return xcb_wait_for_reply(conn, sequence, NULL);
+}
+
+static void parseClass(xcb_get_property_reply_t *r, uint32_t n,
+                       PropCache *pc) {
+  const char *value = xcb_get_property_value(r);
+  size_t len;
+
+  /* WM_CLASS holds instance and class as two NUL terminated strings */
+  len = strnlen(value, n);
+  safe_strcpy(pc->instance, value, MIN(len + 1, sizeof pc->instance));
+  if (len + 1 < n)
+    safe_strcpy(pc->class, value + len + 1,
+                MIN(strnlen(value + len + 1, n - len - 1) + 1,
+                    sizeof pc->class));
+}
+
+static void parseSizeHints(uint32_t *v, uint32_t n, XSizeHints *size) {
+  size->flags = v[0];
+  size->x = v[1];
+  size->y = v[2];
+  size->width = v[3];
+  size->height = v[4];
+  size->min_width = v[5];
+  size->min_height = v[6];
+  size->max_width = v[7];
+  size->max_height = v[8];
+  size->width_inc = v[9];
+  size->height_inc = v[10];
+  size->min_aspect.x = v[11];
+  size->min_aspect.y = v[12];
+  size->max_aspect.x = v[13];
+  size->max_aspect.y = v[14];
+  if (n < SIZE_HINTS_ELEMENTS) {
+    size->base_width = size->base_height = 0;
+    size->win_gravity = 0;
+    size->flags &= ~(PBaseSize | PWinGravity);
+  } else {
+    size->base_width = v[15];
+    size->base_height = v[16];
+    size->win_gravity = v[17];
+  }
+}
+
+static void parseHints(uint32_t *v, uint32_t n, XWMHints *hints) {
+  hints->flags = v[0];
+  hints->input = v[1];
+  hints->initial_state = v[2];
+  hints->icon_pixmap = v[3];
+  hints->icon_window = v[4];
+  hints->icon_x = v[5];
+  hints->icon_y = v[6];
+  hints->icon_mask = v[7];
+  hints->window_group = n < WM_HINTS_ELEMENTS ? 0 : v[8];
+}
+
+/* Copies a title property into text, converting other encodings to the
+ * locale's like XmbTextPropertyToTextList() does for XGetTextProperty() */
+static void parseTitle(xcb_get_property_reply_t *r, char *text, size_t size) {
+  XTextProperty prop;
+  char **list = NULL;
+  int n;
+
+  text[0] = '\0';
+  if (!r || r->format != 8 || !xcb_get_property_value_length(r))
+    return;
+  if (r->type == XA_STRING) {
+    n = MIN((size_t)xcb_get_property_value_length(r), size - 1);
+    memcpy(text, xcb_get_property_value(r), n);
+    text[n] = '\0';
+    return;
+  }
+  prop.value = xcb_get_property_value(r);
+  prop.encoding = r->type;
+  prop.format = r->format;
+  prop.nitems = xcb_get_property_value_length(r);
+  if (XmbTextPropertyToTextList(display, &prop, &list, &n) >= Success &&
+      n > 0 && *list)
+    safe_strcpy(text, *list, size);
+  if (list)
+    XFreeStringList(list);
+}
+
+/* Resets the cached value of a query to what an unset property means */
+static void clearProperty(int p, PropCache *pc) {
+  switch (p) {
+  case QUERY_CLASS:
+    pc->class[0] = pc->instance[0] = '\0';
+    break;
+  case QUERY_NET_WM_STATE:
+    pc->netState = None;
+    pc->netStateCount = 0;
+    break;
+  case QUERY_WINDOW_TYPE:
+    pc->windowType = None;
+    break;
+  case QUERY_NORMAL_HINTS:
+    memset(&pc->sizeHints, 0, sizeof pc->sizeHints);
+    pc->sizeHints.flags = PSize;
+    break;
+  case QUERY_HINTS:
+    pc->hasWMHints = 0;
+    break;
+  case QUERY_PROTOCOLS:
+    pc->protocols = 0;
+    break;
+  }
+}
+
+/* Parses the reply to a cached query into pc, info may be NULL */
+static void parseProperty(int p, xcb_get_property_reply_t *r, PropCache *pc,
+                          WindowInfo *info) {
+  uint32_t *v, n, i;
+
+  if (p == QUERY_NET_WM_NAME || p == QUERY_WM_NAME) {
+    /* WM_NAME only stands in for a missing _NET_WM_NAME */
+    if (info && (p == QUERY_NET_WM_NAME || !info->name[0]))
+      parseTitle(r, info->name, sizeof info->name);
+    return;
+  }
+  clearProperty(p, pc);
+  if (!r || r->format != (p == QUERY_CLASS ? 8 : 32))
+    return;
+  n = xcb_get_property_value_length(r) / (r->format / 8);
+  v = xcb_get_property_value(r);
+  switch (p) {
+  case QUERY_TRANSIENT_FOR:
+    if (info && n >= 1)
+      info->transientFor = v[0];
+    break;
+  case QUERY_CLASS:
+    if (n > 0)
+      parseClass(r, n, pc);
+    break;
+  case QUERY_NET_WM_STATE:
+    if (n >= 1)
+      pc->netState = v[0];
+    for (i = 0; i < n && i < MAX_NET_STATES; i++)
+      pc->netStates[i] = v[i];
+    pc->netStateCount = i;
+    break;
+  case QUERY_WINDOW_TYPE:
+    if (n >= 1)
+      pc->windowType = v[0];
+    break;
+  case QUERY_NORMAL_HINTS:
+    if (n >= OLD_SIZE_HINTS_ELEMENTS)
+      parseSizeHints(v, n, &pc->sizeHints);
+    break;
+  case QUERY_HINTS:
+    if ((pc->hasWMHints = n >= WM_HINTS_ELEMENTS - 1))
+      parseHints(v, n, &pc->wmHints);
+    break;
+  case QUERY_PROTOCOLS:
+    for (i = 0; i < n; i++)
+      if (v[i] == wmAtoms[WM_DELETE])
+        pc->protocols |= PROTOCOL_DELETE;
+      else if (v[i] == wmAtoms[WM_TAKE_FOCUS])
+        pc->protocols |= PROTOCOL_TAKE_FOCUS;
+    break;
+  case QUERY_WM_STATE:
+    if (info && n >= 1)
+      info->wmState = v[0];
+    break;
+  }
+}
+
+/* Waits for the replies to queryWindow(), returns 0 if the window is gone */
+int collectWindowInfo(WindowQuery *q, WindowInfo *info) {
+  xcb_connection_t *conn = XGetXCBConnection(display);
+  xcb_get_window_attributes_reply_t *attrs;
+  xcb_get_geometry_reply_t *geom;
+  xcb_get_property_reply_t *r;
+  int p;
+
+  memset(info, 0, sizeof *info);
+  info->wmState = -1;
+
+  attrs = awaitReply(conn, q->attributes.sequence);
+  geom = awaitReply(conn, q->geometry.sequence);
+  if (!attrs || !geom) {
+    free(attrs);
+    free(geom);
+    for (p = 0; p < QUERY_PROP_COUNT; p++)
+      xcb_discard_reply(conn, q->props[p].sequence);
+    return 0;
+  }
+  info->overrideRedirect = attrs->override_redirect;
+  info->mapState = attrs->map_state;
+  info->x = geom->x;
+  info->y = geom->y;
+  info->width = geom->width;
+  info->height = geom->height;
+  info->borderWidth = geom->border_width;
+  free(attrs);
+  free(geom);
+
+  for (p = 0; p < QUERY_PROP_COUNT; p++) {
+    r = awaitReply(conn, q->props[p].sequence);
+    parseProperty(p, r, &info->props, info);
+    free(r);
+  }
+  info->props.valid = PROP_ALL;
+  return 1;
+}
+
+/* Drops the cached copy of atom so the next read goes to the server */
+void invalidateWindowProps(Client *c, Atom atom) {
+  PropCache *pc = &c->cold->props;
+
+  if (atom == wmAtoms[WM_PROTOCOLS])
+    pc->valid &= ~PROP_PROTOCOLS;
+  else if (atom == XA_WM_HINTS)
+    pc->valid &= ~PROP_HINTS;
+  else if (atom == XA_WM_NORMAL_HINTS)
+    pc->valid &= ~PROP_NORMAL_HINTS;
+  else if (atom == XA_WM_CLASS)
+    pc->valid &= ~PROP_CLASS;
+  else if (atom == netAtoms[NET_WM_WINDOW_TYPE])
+    pc->valid &= ~PROP_WINDOW_TYPE;
+  else if (atom == netAtoms[NET_WM_STATE])
+    pc->valid &= ~PROP_STATE;
+}
+
+/* Refetches the stale properties among which, pipelined in one round-trip */
+void refreshWindowProps(Client *c, unsigned int which) {
+  PropCache *pc = &c->cold->props;
+  xcb_connection_t *conn;
+  xcb_get_property_cookie_t cookies[LENGTH(cachedProps)];
+  xcb_get_property_reply_t *r;
+  unsigned int i, stale = which & ~pc->valid;
+
+  if (!stale)
+    return;
+  conn = XGetXCBConnection(display);
+  for (i = 0; i < LENGTH(cachedProps); i++)
+    if (stale & cachedProps[i].bit)
+      cookies[i] = requestProperty(conn, c->win, cachedProps[i].query);
+  for (i = 0; i < LENGTH(cachedProps); i++)
+    if (stale & cachedProps[i].bit) {
+      r = awaitReply(conn, cookies[i].sequence);
+      parseProperty(cachedProps[i].query, r, pc, NULL);
+      free(r);
+    }
+  pc->valid |= stale;
+}
+
+unsigned int getWindowProtocols(Client *c) {
+  refreshWindowProps(c, PROP_PROTOCOLS);
+  return c->cold->props.protocols;
+}
+
+/* Returns NULL if the window has no WM_HINTS */
+XWMHints *getWindowManagerHints(Client *c) {
+  refreshWindowProps(c, PROP_HINTS);
+  return c->cold->props.hasWMHints ? &c->cold->props.wmHints : NULL;
+}
+
+XSizeHints *getWindowSizeHints(Client *c) {
+  refreshWindowProps(c, PROP_NORMAL_HINTS);
+  return &c->cold->props.sizeHints;
+}
+
+/* Reads the title like collectWindowInfo() does, both requests in one
+ * round-trip */
+void fetchWindowTitle(Window w, char *text, size_t size) {
+  xcb_connection_t *conn = XGetXCBConnection(display);
+  xcb_get_property_cookie_t net, legacy;
+  xcb_get_property_reply_t *r;
+
+  net = requestProperty(conn, w, QUERY_NET_WM_NAME);
+  legacy = requestProperty(conn, w, QUERY_WM_NAME);
+  r = awaitReply(conn, net.sequence);
+  parseTitle(r, text, size);
+  free(r);
+  if (text[0]) {
+    xcb_discard_reply(conn, legacy.sequence);
+    return;
+  }
+  r = awaitReply(conn, legacy.sequence);
+  parseTitle(r, text, size);
+  free(r);
+}
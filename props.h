@@ -0,0 +1,35 @@
+#ifndef _PROPS_H_
+#define _PROPS_H_
+
+#include <X11/Xlib.h>
+#include <xcb/xcb.h>
+
+#include "atlas.h"
+
+// Properties fetched together when a window is first seen
+enum WindowQueryProp {
+  QUERY_TRANSIENT_FOR,
+  QUERY_CLASS,
+  QUERY_NET_WM_STATE,
+  QUERY_WINDOW_TYPE,
+  QUERY_NORMAL_HINTS,
+  QUERY_HINTS,
+  QUERY_PROTOCOLS,
+  QUERY_WM_STATE,
+  QUERY_NET_WM_NAME,
+  QUERY_WM_NAME, /* after QUERY_NET_WM_NAME, which it is the fallback for */
+  QUERY_PROP_COUNT
+};
+
+// Outstanding requests for one window, answered by collectWindowInfo()
+typedef struct {
+  xcb_get_window_attributes_cookie_t attributes;
+  xcb_get_geometry_cookie_t geometry;
+  xcb_get_property_cookie_t props[QUERY_PROP_COUNT];
+} WindowQuery;
+
+// Function declarations
+void queryWindow(Window w, WindowQuery *q);
+int collectWindowInfo(WindowQuery *q, WindowInfo *info);
+
+#endif // _PROPS_H_
@@ -0,0 +1,157 @@
+// SHADOW
+// "What does the server already have?"
+
+#include "atlas.h"
+#include "util.h"
+#include <X11/Xlib.h>
+
+/* Every managed window carries a copy of the state we last gave the server,
+ * seeded from what manage() found. Nothing else changes that state on a
+ * managed window: its configure and map requests come through us, and a real
+ * unmap unmanages it. So writes that match the copy are dropped, and counted
+ * in eventStats.suppressedRequests.
+ *
+ * This only holds if every write to a managed window goes through here. The
+ * raw requests left are:
+ * - the button grabs in registerMouseButtons(), behind buttonGrabsChanged()
+ * - unmanage() restoring the border and dropping the grabs, after which the
+ *   shadow is gone
+ * - handleConfigureRequest() forwarding requests of unmanaged windows
+ * Debug builds check the copy against the server, see verifyWindowShadows() */
+
+void seedWindowShadow(Client *c, WindowInfo *info) {
+  WindowShadow *s = &c->cold->shadow;
+  unsigned int i;
+
+  s->x = info->x;
+  s->y = info->y;
+  s->w = info->width;
+  s->h = info->height;
+  s->borderWidth = info->borderWidth;
+  s->hasBorderPixel = 0;
+  s->mapped = info->mapState != IsUnmapped;
+  s->grabs = GRABS_NONE;
+  /* updateNetWMState() writes the atoms it manages on top of these, the
+   * first time whatever they are */
+  s->netState = -1;
+  s->otherStateCount = 0;
+  for (i = 0; i < info->props.netStateCount; i++)
+    if (info->props.netStates[i] != netAtoms[NET_WM_FULLSCREEN] &&
+        info->props.netStates[i] != netAtoms[NET_WM_HIDDEN])
+      s->otherStates[s->otherStateCount++] = info->props.netStates[i];
+}
+
+/* Sends only the fields that differ, returns whether a request went out. The
+ * server answers a real one with a ConfigureNotify, so callers only need
+ * configure() when this returns 0 */
+int configureWindow(Client *c, int x, int y, int w, int h, int borderWidth) {
+  WindowShadow *s = &c->cold->shadow;
+  XWindowChanges wc;
+  unsigned int mask = 0;
+
+  if (x != s->x)
+    mask |= CWX, s->x = wc.x = x;
+  if (y != s->y)
+    mask |= CWY, s->y = wc.y = y;
+  if (w != s->w)
+    mask |= CWWidth, s->w = wc.width = w;
+  if (h != s->h)
+    mask |= CWHeight, s->h = wc.height = h;
+  if (borderWidth != s->borderWidth)
+    mask |= CWBorderWidth, s->borderWidth = wc.border_width = borderWidth;
+  if (!mask) {
+    eventStats.suppressedRequests++;
+    return 0;
+  }
+  XConfigureWindow(display, c->win, mask, &wc);
+  return 1;
+}
+
+int moveWindowTo(Client *c, int x, int y) {
+  WindowShadow *s = &c->cold->shadow;
+
+  return configureWindow(c, x, y, s->w, s->h, s->borderWidth);
+}
+
+int setWindowBorderWidth(Client *c, int borderWidth) {
+  WindowShadow *s = &c->cold->shadow;
+
+  return configureWindow(c, s->x, s->y, s->w, s->h, borderWidth);
+}
+
+void setWindowBorderPixel(Client *c, unsigned long pixel) {
+  WindowShadow *s = &c->cold->shadow;
+
+  if (s->hasBorderPixel && s->borderPixel == pixel) {
+    eventStats.suppressedRequests++;
+    return;
+  }
+  s->borderPixel = pixel;
+  s->hasBorderPixel = 1;
+  XSetWindowBorder(display, c->win, pixel);
+}
+
+int mapWindow(Client *c) {
+  if (c->cold->shadow.mapped) {
+    eventStats.suppressedRequests++;
+    return 0;
+  }
+  c->cold->shadow.mapped = 1;
+  XMapWindow(display, c->win);
+  return 1;
+}
+
+/* Returns whether an UnmapNotify is coming */
+int unmapWindow(Client *c) {
+  if (!c->cold->shadow.mapped) {
+    eventStats.suppressedRequests++;
+    return 0;
+  }
+  c->cold->shadow.mapped = 0;
+  XUnmapWindow(display, c->win);
+  return 1;
+}
+
+/* Records the button grabs c is about to get, returns 0 if it already has
+ * them and the grab requests can be skipped */
+int buttonGrabsChanged(Client *c, int focused) {
+  WindowShadow *s = &c->cold->shadow;
+  int grabs = focused ? GRABS_FOCUSED : GRABS_UNFOCUSED;
+
+  if (s->grabs == grabs && s->grabLocks == numLockMask) {
+    eventStats.suppressedRequests++;
+    return 0;
+  }
+  s->grabs = grabs;
+  s->grabLocks = numLockMask;
+  return 1;
+}
+
+/* Compares every shadow with the server after a commit, only in debug builds
+ * since it costs a round-trip per client. Border pixel and grabs cannot be
+ * queried */
+void verifyWindowShadows(void) {
+#ifdef ATLASWM_DEBUG
+  XWindowAttributes wa;
+  WindowShadow *s;
+  Monitor *m;
+  Client *c;
+
+  for (m = monitors; m; m = m->next)
+    for (c = m->clients; c; c = c->next) {
+      /* fails for windows destroyed but not unmanaged yet */
+      if (!XGetWindowAttributes(display, c->win, &wa))
+        continue;
+      s = &c->cold->shadow;
+      if (wa.x != s->x || wa.y != s->y || wa.width != s->w ||
+          wa.height != s->h || wa.border_width != s->borderWidth)
+        LOG_ERROR("Shadow of window 0x%lx has %dx%d+%d+%d border %d, server "
+                  "%dx%d+%d+%d border %d",
+                  c->win, s->w, s->h, s->x, s->y, s->borderWidth, wa.width,
+                  wa.height, wa.x, wa.y, wa.border_width);
+      if ((wa.map_state != IsUnmapped) != s->mapped)
+        LOG_ERROR("Shadow of window 0x%lx is %smapped, server disagrees",
+                  c->win, s->mapped ? "" : "un");
+    }
+#endif
+}
@@ -22,29 +22,31 @@ static const Rule rules[] = {
 };
 /* HACK: End of hack*/
 
-void manage(Window w, XWindowAttributes *wa) {
+/* info comes from queryWindow()/collectWindowInfo(), so managing a window does
+ * not wait on the server for each property */
+void manage(Window w, WindowInfo *info) {
   Client *c, *t = NULL;
-  Window trans = None;
-  XWindowChanges wc;
+  Window trans = info->transientFor;
 
-  c = ecalloc(1, sizeof(Client));
+  c = allocClient();
   c->win = w;
   /* geometry */
-  c->x = c->oldx = wa->x;
-  c->y = c->oldy = wa->y;
-  c->w = c->oldw = wa->width;
-  c->h = c->oldh = wa->height;
-  c->oldBorderWidth = wa->border_width;
-  c->horizontalRatio = 0.5;
-  c->verticalRatio = 0.5;
-
-  if (XGetTransientForHint(display, w, &trans) &&
-      (t = findClientFromWindow(trans))) {
+  c->x = c->cold->oldx = info->x;
+  c->y = c->cold->oldy = info->y;
+  c->w = c->cold->oldw = info->width;
+  c->h = c->cold->oldh = info->height;
+  c->cold->oldBorderWidth = info->borderWidth;
+  c->cold->props = info->props;
+  safe_strcpy(c->cold->name, info->name[0] ? info->name : broken,
+              sizeof c->cold->name);
+  seedWindowShadow(c, info);
+
+  if (trans != None && (t = findClientFromWindow(trans))) {
     c->monitor = t->monitor;
     c->workspaces = t->workspaces;
   } else {
     c->monitor = selectedMonitor;
-    applyWindowRules(c);
+    applyWindowRules(c, c->cold->props.class, c->cold->props.instance);
   }
 
   if (c->x + WIDTH(c) > c->monitor->wx + c->monitor->ww)
@@ -55,151 +57,161 @@ void manage(Window w, XWindowAttributes *wa) {
   c->y = MAX(c->y, c->monitor->wy);
   c->borderWidth = cfg.borderWidth;
 
-  wc.border_width = c->borderWidth;
-  XConfigureWindow(display, w, CWBorderWidth, &wc);
-  Clr borderColor;
-  drw_clr_create(drawContext, &borderColor, cfg.borderInactiveColor);
-  XSetWindowBorder(display, w, borderColor.pixel);
-  configure(c); /* propagates border_width, if size doesn't change */
-  updateWindowTypeProps(c);
-  updateWindowSizeHints(c);
-  updateWindowManagerHints(c);
+  /* propagates border_width, if the server did not already have it */
+  if (!setWindowBorderWidth(c, c->borderWidth))
+    configure(c);
+  applyWindowTypeProps(c, c->cold->props.netState,
+                       c->cold->props.windowType);
+  applyWindowSizeHints(c, &c->cold->props.sizeHints);
+  if (c->cold->props.hasWMHints)
+    applyWindowManagerHints(c, &c->cold->props.wmHints);
   XSelectInput(display, w,
                EnterWindowMask | FocusChangeMask | PropertyChangeMask |
                    StructureNotifyMask);
   registerMouseButtons(c, 0);
   if (!c->isFloating)
     c->isFloating = c->previousState = trans != None || c->isFixedSize;
+  setClientBorder(c, 0);
   if (c->isFloating)
     XRaiseWindow(display, c->win);
   attach(c);
   attachWindowToStack(c);
-  XChangeProperty(display, root, netAtoms[NET_CLIENT_LIST], XA_WINDOW, 32,
-                  PropModeAppend, (unsigned char *)&(c->win), 1);
-  XMoveResizeWindow(display, c->win, c->x + 2 * screenWidth, c->y, c->w,
-                    c->h); /* some windows require this */
-  setclientstate(c, NormalState);
+  scheduleClientListUpdate();
+  configureWindow(c, c->x + 2 * screenWidth, c->y, c->w, c->h,
+                  c->borderWidth); /* some windows require this */
   if (c->monitor == selectedMonitor)
     unfocus(selectedMonitor->active, 0);
   c->monitor->active = c;
-  arrange(c->monitor);
-  XMapWindow(display, c->win);
-  if (cfg.focusNewWindows) {
-    focus(c);
-    moveCursorToClientCenter(c);
+  scheduleArrange(c->monitor);
+  if (ISVISIBLE(c) || cfg.hideMode != HIDE_UNMAP) {
+    setclientstate(c, NormalState);
+    mapWindow(c);
+  } else if (info->mapState == IsViewable) {
+    hideWindow(c);
   } else {
-    focus(NULL);
+    /* a window mapped onto a hidden workspace stays unmapped until viewed */
+    c->isHidden = 1;
+    setclientstate(c, IconicState);
+    updateNetWMState(c);
   }
+  if (cfg.focusNewWindows)
+    scheduleFocus(c, 1);
+  else
+    scheduleFocus(NULL, 0);
 }
 
 void unmanage(Client *c, int destroyed) {
   Monitor *m = c->monitor;
+  Client *prev = c->prev;
   XWindowChanges wc;
 
-  Client *prev = NULL;
-  Client *curr = m->clients;
-  // Find the previous client
-  while (curr && curr != c) {
-    prev = curr;
-    curr = curr->next;
-  }
-
   detach(c);
   detachWindowFromStack(c);
   if (!destroyed) {
-    wc.border_width = c->oldBorderWidth;
+    unsigned long first = startIgnoringXErrors();
+    wc.border_width = c->cold->oldBorderWidth;
     XGrabServer(display); /* avoid race conditions */
-    XSetErrorHandler(handleXErrorDummy);
     XSelectInput(display, c->win, NoEventMask);
     XConfigureWindow(display, c->win, CWBorderWidth, &wc); /* restore border */
     XUngrabButton(display, AnyButton, AnyModifier, c->win);
     setclientstate(c, WithdrawnState);
-    XSync(display, False);
-    XSetErrorHandler(handleXError);
     XUngrabServer(display);
+    stopIgnoringXErrors(first);
   }
-  free(c);
+  forgetScheduled(c);
+  freeClient(c);
 
-  focus(prev);
-  updateClientList();
-  arrange(m);
+  scheduleFocus(prev, 0);
+  scheduleClientListUpdate();
+  scheduleArrange(m);
 }
 
 void updateWindowTitle(Client *c) {
-  if (!gettextprop(c->win, netAtoms[NET_WM_NAME], c->name, sizeof c->name))
-    gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-  if (c->name[0] == '\0') /* hack to mark broken clients */
-    strcpy(c->name, broken);
+  char *name = c->cold->name;
+
+  fetchWindowTitle(c->win, name, sizeof c->cold->name);
+  if (name[0] == '\0') /* hack to mark broken clients */
+    strcpy(name, broken);
 }
 
 void updateWindowTypeProps(Client *c) {
-  Atom state = getatomprop(c, netAtoms[NET_WM_STATE]);
-  Atom wtype = getatomprop(c, netAtoms[NET_WM_WINDOW_TYPE]);
+  refreshWindowProps(c, PROP_STATE | PROP_WINDOW_TYPE);
+  applyWindowTypeProps(c, c->cold->props.netState,
+                       c->cold->props.windowType);
+}
 
+void applyWindowTypeProps(Client *c, Atom state, Atom wtype) {
   if (state == netAtoms[NET_WM_FULLSCREEN])
     setWindowFullscreen(c, 1);
-  if (wtype == netAtoms[NET_WM_WINDOW_TYPE_DIALOG])
+  if (wtype == netAtoms[NET_WM_WINDOW_TYPE_DIALOG] && !c->isFloating) {
     c->isFloating = 1;
+    relinkVisibleClient(c);
+    invalidateLayout(c->monitor, c->workspaces);
+  }
 }
 
 void updateWindowManagerHints(Client *c) {
   XWMHints *wmh;
 
-  if ((wmh = XGetWMHints(display, c->win))) {
-    if (c == selectedMonitor->active && wmh->flags & XUrgencyHint) {
-      wmh->flags &= ~XUrgencyHint;
-      XSetWMHints(display, c->win, wmh);
-    } else
-      c->isUrgent = (wmh->flags & XUrgencyHint) ? 1 : 0;
-    if (wmh->flags & InputHint)
-      c->neverFocus = !wmh->input;
-    else
-      c->neverFocus = 0;
-    XFree(wmh);
+  if ((wmh = getWindowManagerHints(c)))
+    applyWindowManagerHints(c, wmh);
+}
+
+void applyWindowManagerHints(Client *c, XWMHints *wmh) {
+  if (c == selectedMonitor->active && wmh->flags & XUrgencyHint) {
+    wmh->flags &= ~XUrgencyHint;
+    XSetWMHints(display, c->win, wmh);
+  } else if (c->isUrgent != !!(wmh->flags & XUrgencyHint)) {
+    c->isUrgent = !c->isUrgent;
+    if (c != selectedMonitor->active)
+      setClientBorder(c, 0);
   }
+  if (wmh->flags & InputHint)
+    c->neverFocus = !wmh->input;
+  else
+    c->neverFocus = 0;
 }
 
 void updateWindowSizeHints(Client *c) {
-  long msize;
-  XSizeHints size;
-
-  if (!XGetWMNormalHints(display, c->win, &size, &msize))
-    /* size is uninitialized, ensure that size.flags aren't used */
-    size.flags = PSize;
-  if (size.flags & PBaseSize) {
-    c->basew = size.base_width;
-    c->baseh = size.base_height;
-  } else if (size.flags & PMinSize) {
-    c->basew = size.min_width;
-    c->baseh = size.min_height;
+  applyWindowSizeHints(c, getWindowSizeHints(c));
+}
+
+void applyWindowSizeHints(Client *c, XSizeHints *size) {
+  ClientCold *cold = c->cold;
+
+  if (size->flags & PBaseSize) {
+    cold->basew = size->base_width;
+    cold->baseh = size->base_height;
+  } else if (size->flags & PMinSize) {
+    cold->basew = size->min_width;
+    cold->baseh = size->min_height;
   } else
-    c->basew = c->baseh = 0;
-  if (size.flags & PResizeInc) {
-    c->incw = size.width_inc;
-    c->inch = size.height_inc;
+    cold->basew = cold->baseh = 0;
+  if (size->flags & PResizeInc) {
+    cold->incw = size->width_inc;
+    cold->inch = size->height_inc;
   } else
-    c->incw = c->inch = 0;
-  if (size.flags & PMaxSize) {
-    c->maxw = size.max_width;
-    c->maxh = size.max_height;
+    cold->incw = cold->inch = 0;
+  if (size->flags & PMaxSize) {
+    cold->maxw = size->max_width;
+    cold->maxh = size->max_height;
   } else
-    c->maxw = c->maxh = 0;
-  if (size.flags & PMinSize) {
-    c->minw = size.min_width;
-    c->minh = size.min_height;
-  } else if (size.flags & PBaseSize) {
-    c->minw = size.base_width;
-    c->minh = size.base_height;
+    cold->maxw = cold->maxh = 0;
+  if (size->flags & PMinSize) {
+    cold->minw = size->min_width;
+    cold->minh = size->min_height;
+  } else if (size->flags & PBaseSize) {
+    cold->minw = size->base_width;
+    cold->minh = size->base_height;
   } else
-    c->minw = c->minh = 0;
-  if (size.flags & PAspect) {
-    c->minAspectRatio = (float)size.min_aspect.y / size.min_aspect.x;
-    c->maxAspectRatio = (float)size.max_aspect.x / size.max_aspect.y;
+    cold->minw = cold->minh = 0;
+  if (size->flags & PAspect) {
+    cold->minAspectRatio = (float)size->min_aspect.y / size->min_aspect.x;
+    cold->maxAspectRatio = (float)size->max_aspect.x / size->max_aspect.y;
   } else
-    c->maxAspectRatio = c->minAspectRatio = 0.0;
-  c->isFixedSize =
-      (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
-  c->hintsvalid = 1;
+    cold->maxAspectRatio = cold->minAspectRatio = 0.0;
+  c->isFixedSize = (cold->maxw && cold->maxh && cold->maxw == cold->minw &&
+                    cold->maxh == cold->minh);
 }
 
 void configure(Client *c) {
@@ -219,23 +231,20 @@ void configure(Client *c) {
   XSendEvent(display, c->win, False, StructureNotifyMask, (XEvent *)&ce);
 }
 
-void applyWindowRules(Client *c) {
-  const char *class, *instance;
+void applyWindowRules(Client *c, const char *class, const char *instance) {
   unsigned int i;
   const Rule *r;
   Monitor *m;
-  XClassHint ch = {NULL, NULL};
 
   /* rule matching */
   c->isFloating = 0;
   c->workspaces = 0;
-  XGetClassHint(display, c->win, &ch);
-  class = ch.res_class ? ch.res_class : broken;
-  instance = ch.res_name ? ch.res_name : broken;
+  class = class[0] ? class : broken;
+  instance = instance[0] ? instance : broken;
 
   for (i = 0; i < LENGTH(rules); i++) {
     r = &rules[i];
-    if ((!r->title || strstr(c->name, r->title)) &&
+    if ((!r->title || strstr(c->cold->name, r->title)) &&
         (!r->class || strstr(class, r->class)) &&
         (!r->instance || strstr(instance, r->instance))) {
       c->isFloating = r->isfloating;
@@ -246,10 +255,6 @@ void applyWindowRules(Client *c) {
         c->monitor = m;
     }
   }
-  if (ch.res_class)
-    XFree(ch.res_class);
-  if (ch.res_name)
-    XFree(ch.res_name);
   c->workspaces =
       c->workspaces & WORKSPACEMASK
           ? c->workspaces & WORKSPACEMASK
@@ -258,6 +263,7 @@ void applyWindowRules(Client *c) {
 
 int applyWindowSizeConstraints(Client *c, int *x, int *y, int *w, int *h,
                                int interact) {
+  ClientCold *cold = c->cold;
   int baseismin;
   Monitor *m = c->monitor;
 
@@ -285,66 +291,69 @@ int applyWindowSizeConstraints(Client *c, int *x, int *y, int *w, int *h,
   }
   if (c->isFloating ||
       !c->monitor->layouts[c->monitor->selectedLayout]->arrange) {
-    if (!c->hintsvalid)
+    if (!(cold->props.valid & PROP_NORMAL_HINTS))
       updateWindowSizeHints(c);
     /* see last two sentences in ICCCM 4.1.2.3 */
-    baseismin = c->basew == c->minw && c->baseh == c->minh;
+    baseismin = cold->basew == cold->minw && cold->baseh == cold->minh;
     if (!baseismin) { /* temporarily remove base dimensions */
-      *w -= c->basew;
-      *h -= c->baseh;
+      *w -= cold->basew;
+      *h -= cold->baseh;
     }
     /* adjust for aspect limits */
-    if (c->minAspectRatio > 0 && c->maxAspectRatio > 0) {
-      if (c->maxAspectRatio < (float)*w / *h)
-        *w = *h * c->maxAspectRatio + 0.5;
-      else if (c->minAspectRatio < (float)*h / *w)
-        *h = *w * c->minAspectRatio + 0.5;
+    if (cold->minAspectRatio > 0 && cold->maxAspectRatio > 0) {
+      if (cold->maxAspectRatio < (float)*w / *h)
+        *w = *h * cold->maxAspectRatio + 0.5;
+      else if (cold->minAspectRatio < (float)*h / *w)
+        *h = *w * cold->minAspectRatio + 0.5;
     }
     if (baseismin) { /* increment calculation requires this */
-      *w -= c->basew;
-      *h -= c->baseh;
+      *w -= cold->basew;
+      *h -= cold->baseh;
     }
     /* adjust for increment value */
-    if (c->incw)
-      *w -= *w % c->incw;
-    if (c->inch)
-      *h -= *h % c->inch;
+    if (cold->incw)
+      *w -= *w % cold->incw;
+    if (cold->inch)
+      *h -= *h % cold->inch;
     /* restore base dimensions */
-    *w = MAX(*w + c->basew, c->minw);
-    *h = MAX(*h + c->baseh, c->minh);
-    if (c->maxw)
-      *w = MIN(*w, c->maxw);
-    if (c->maxh)
-      *h = MIN(*h, c->maxh);
+    *w = MAX(*w + cold->basew, cold->minw);
+    *h = MAX(*h + cold->baseh, cold->minh);
+    if (cold->maxw)
+      *w = MIN(*w, cold->maxw);
+    if (cold->maxh)
+      *h = MIN(*h, cold->maxh);
   }
   return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
 
 void setWindowFullscreen(Client *c, int fullscreen) {
   if (fullscreen && !c->isFullscreen) {
-    XChangeProperty(display, c->win, netAtoms[NET_WM_STATE], XA_ATOM, 32,
-                    PropModeReplace,
-                    (unsigned char *)&netAtoms[NET_WM_FULLSCREEN], 1);
     c->isFullscreen = 1;
+    updateNetWMState(c);
     c->previousState = c->isFloating;
-    c->oldBorderWidth = c->borderWidth;
+    c->cold->oldBorderWidth = c->borderWidth;
     c->borderWidth = 0;
     c->isFloating = 1;
+    relinkVisibleClient(c);
+    invalidateLayout(c->monitor, c->workspaces);
     resizeclient(c, c->monitor->mx, c->monitor->my, c->monitor->mw,
                  c->monitor->mh);
     XRaiseWindow(display, c->win);
+    updateOcclusion(c->monitor);
   } else if (!fullscreen && c->isFullscreen) {
-    XChangeProperty(display, c->win, netAtoms[NET_WM_STATE], XA_ATOM, 32,
-                    PropModeReplace, (unsigned char *)0, 0);
     c->isFullscreen = 0;
+    updateNetWMState(c);
     c->isFloating = c->previousState;
-    c->borderWidth = c->oldBorderWidth;
-    c->x = c->oldx;
-    c->y = c->oldy;
-    c->w = c->oldw;
-    c->h = c->oldh;
+    c->borderWidth = c->cold->oldBorderWidth;
+    relinkVisibleClient(c);
+    invalidateLayout(c->monitor, c->workspaces);
+    c->x = c->cold->oldx;
+    c->y = c->cold->oldy;
+    c->w = c->cold->oldw;
+    c->h = c->cold->oldh;
     resizeclient(c, c->x, c->y, c->w, c->h);
-    arrange(c->monitor);
+    updateOcclusion(c->monitor);
+    scheduleArrange(c->monitor);
   }
 }
 
@@ -352,11 +361,10 @@ void setWindowUrgent(Client *c, int urg) {
   XWMHints *wmh;
 
   c->isUrgent = urg;
-  if (!(wmh = XGetWMHints(display, c->win)))
+  if (!(wmh = getWindowManagerHints(c)))
     return;
   wmh->flags = urg ? (wmh->flags | XUrgencyHint) : (wmh->flags & ~XUrgencyHint);
   XSetWMHints(display, c->win, wmh);
-  XFree(wmh);
 }
 
 void toggleWindowFloating(const Arg *arg) {
@@ -367,29 +375,98 @@ void toggleWindowFloating(const Arg *arg) {
     return;
   selectedMonitor->active->isFloating = !selectedMonitor->active->isFloating ||
                                         selectedMonitor->active->isFixedSize;
+  relinkVisibleClient(selectedMonitor->active);
+  invalidateLayout(selectedMonitor, selectedMonitor->active->workspaces);
   if (selectedMonitor->active->isFloating)
     resize(selectedMonitor->active, selectedMonitor->active->x,
            selectedMonitor->active->y, selectedMonitor->active->w,
            selectedMonitor->active->h, 0);
-  arrange(selectedMonitor);
+  scheduleArrange(selectedMonitor);
 }
 
-void toggleWindowVisibility(Client *c) {
-  if (!c)
-    return;
-  if (ISVISIBLE(c)) {
+/* Shows or hides windows to match m's workspaces. Only windows whose
+ * visibility changed since the last call get a request, and nothing is
+ * walked unless shownDirty says visibility may have changed */
+void updateWindowVisibility(Monitor *m) {
+  Client *c;
+
+  if (m->shownDirty) {
+    m->shownDirty = 0;
     /* show clients top down */
-    XMoveWindow(display, c->win, c->x, c->y);
-    if ((!c->monitor->layouts[c->monitor->selectedLayout]->arrange ||
-         c->isFloating) &&
-        !c->isFullscreen)
+    for (c = m->stack; c; c = c->nextInStack)
+      if (ISVISIBLE(c) && (!c->isShown || c->isHidden))
+        showWindow(c);
+    /* hide clients bottom up */
+    for (c = m->stackBottom; c; c = c->prevInStack)
+      if (!ISVISIBLE(c) && c->isShown)
+        hideWindow(c);
+  }
+  /* floating geometry is only sent when its hints change it */
+  for (c = m->layouts[m->selectedLayout]->arrange ? firstFloatingClient(m)
+                                                 : firstVisibleClient(m);
+       c; c = nextVisibleClient(c))
+    if (!c->isFullscreen)
       resize(c, c->x, c->y, c->w, c->h, 0);
-    toggleWindowVisibility(c->nextInStack);
+}
+
+void showWindow(Client *c) {
+  /* configure requests that came in while hidden may have resized it */
+  configureWindow(c, c->x, c->y, c->w, c->h, c->borderWidth);
+  if (c->isHidden) {
+    mapWindow(c);
+    c->isHidden = 0;
+    setclientstate(c, NormalState);
+    updateNetWMState(c);
+  }
+  c->isShown = 1;
+}
+
+/* Parks c off screen or unmaps it, depending on cfg.hideMode. Also switches
+ * an already hidden window over after the mode changed */
+void hideWindow(Client *c) {
+  if (cfg.hideMode == HIDE_UNMAP) {
+    if (!c->isHidden) {
+      /* handleWindowUnmap must not take our own unmap for a withdrawal */
+      if (unmapWindow(c))
+        c->ignoreUnmap++;
+      c->isHidden = 1;
+      setclientstate(c, IconicState);
+      updateNetWMState(c);
+    }
   } else {
-    /* hide clients bottom up */
-    toggleWindowVisibility(c->nextInStack);
-    XMoveWindow(display, c->win, WIDTH(c) * -2, c->y);
+    moveWindowTo(c, WIDTH(c) * -2, c->y);
+    if (c->isHidden) {
+      mapWindow(c);
+      c->isHidden = 0;
+      setclientstate(c, NormalState);
+      updateNetWMState(c);
+    }
+  }
+  c->isShown = 0;
+}
+
+/* Writes every _NET_WM_STATE atom we manage in one request, keeping the
+ * atoms the window had that we do not manage. Nothing is sent when the
+ * managed atoms are the ones last written */
+void updateNetWMState(Client *c) {
+  WindowShadow *s = &c->cold->shadow;
+  Atom state[MAX_NET_STATES + 2];
+  unsigned int n = s->otherStateCount;
+  int managed = (c->isFullscreen ? NET_STATE_FULLSCREEN : 0) |
+                (c->isHidden || c->isOccluded ? NET_STATE_HIDDEN : 0);
+
+  if (managed == s->netState) {
+    eventStats.suppressedRequests++;
+    return;
   }
+  s->netState = managed;
+  memcpy(state, s->otherStates, n * sizeof *state);
+  if (c->isFullscreen)
+    state[n++] = netAtoms[NET_WM_FULLSCREEN];
+  if (c->isHidden || c->isOccluded)
+    state[n++] = netAtoms[NET_WM_HIDDEN];
+  XChangeProperty(display, c->win, netAtoms[NET_WM_STATE], XA_ATOM, 32,
+                  PropModeReplace, (unsigned char *)state, n);
 }
 
 void resize(Client *c, int x, int y, int w, int h, int interact) {
@@ -398,21 +475,23 @@ void resize(Client *c, int x, int y, int w, int h, int interact) {
 }
 
 void resizeclient(Client *c, int x, int y, int w, int h) {
-  XWindowChanges wc;
-
-  c->oldx = c->x;
-  c->x = wc.x = x;
-  c->oldy = c->y;
-  c->y = wc.y = y;
-  c->oldw = c->w;
-  c->w = wc.width = w;
-  c->oldh = c->h;
-  c->h = wc.height = h;
-  wc.border_width = c->borderWidth;
-  XConfigureWindow(display, c->win,
-                   CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
-  configure(c);
-  XSync(display, False);
+  c->cold->oldx = c->x;
+  c->x = x;
+  c->cold->oldy = c->y;
+  c->y = y;
+  c->cold->oldw = c->w;
+  c->w = w;
+  c->cold->oldh = c->h;
+  c->h = h;
+  /* a real configure brings its own ConfigureNotify */
+  if (!configureWindow(c, x, y, w, h, c->borderWidth))
+    configure(c);
+  /* the window is now on screen; if it should not be, the next arrange
+   * hides it again */
+  if (!c->isShown) {
+    c->isShown = 1;
+    c->monitor->shownDirty = 1;
+  }
 }
 
 void setclientstate(Client *c, long state) {
@@ -423,16 +502,13 @@ void setclientstate(Client *c, long state) {
 }
 
 int sendevent(Client *c, Atom proto) {
-  int n;
-  Atom *protocols;
   int exists = 0;
   XEvent ev;
 
-  if (XGetWMProtocols(display, c->win, &protocols, &n)) {
-    while (!exists && n--)
-      exists = protocols[n] == proto;
-    XFree(protocols);
-  }
+  if (proto == wmAtoms[WM_DELETE])
+    exists = getWindowProtocols(c) & PROTOCOL_DELETE;
+  else if (proto == wmAtoms[WM_TAKE_FOCUS])
+    exists = getWindowProtocols(c) & PROTOCOL_TAKE_FOCUS;
   if (exists) {
     ev.type = ClientMessage;
     ev.xclient.window = c->win;
@@ -462,60 +538,6 @@ void scaleclient(Client *c, int x, int y, int w, int h, float scale) {
          new_h - 2 * c->borderWidth, 0);
 }
 
-Atom getatomprop(Client *c, Atom prop) {
-  int di;
-  unsigned long dl;
-  unsigned char *p = NULL;
-  Atom da, atom = None;
-
-  if (XGetWindowProperty(display, c->win, prop, 0L, sizeof atom, False, XA_ATOM,
-                         &da, &di, &dl, &dl, &p) == Success &&
-      p) {
-    atom = *(Atom *)p;
-    XFree(p);
-  }
-  return atom;
-}
-
-long getstate(Window w) {
-  int format;
-  long result = -1;
-  unsigned char *p = NULL;
-  unsigned long n, extra;
-  Atom real;
-
-  if (XGetWindowProperty(display, w, wmAtoms[WM_STATE], 0L, 2L, False,
-                         wmAtoms[WM_STATE], &real, &format, &n, &extra,
-                         (unsigned char **)&p) != Success)
-    return -1;
-  if (n != 0)
-    result = *p;
-  XFree(p);
-  return result;
-}
-
-int gettextprop(Window w, Atom atom, char *text, unsigned int size) {
-  char **list = NULL;
-  int n;
-  XTextProperty name;
-
-  if (!text || size == 0)
-    return 0;
-  text[0] = '\0';
-  if (!XGetTextProperty(display, w, &name, atom) || !name.nitems)
-    return 0;
-  if (name.encoding == XA_STRING) {
-    strncpy(text, (char *)name.value, size - 1);
-  } else if (XmbTextPropertyToTextList(display, &name, &list, &n) >= Success &&
-             n > 0 && *list) {
-    strncpy(text, *list, size - 1);
-    XFreeStringList(list);
-  }
-  text[size - 1] = '\0';
-  XFree(name.value);
-  return 1;
-}
-
 void setCurrentDesktop(void) {
   long data[] = {0};
   XChangeProperty(display, root, netAtoms[NET_CURRENT_DESKTOP], XA_CARDINAL, 32,